@@ -0,0 +1,293 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Measures how long the bridge takes to start, and how much memory it uses, against the simulated spectrometer
+
+	Starts specbridge-mock a number of times and reports the median of each startup phase and milestone, as seen by
+	a client (time to first SCPI connection, first frame and calibration) and as reported by STARTUP?.
+
+	Memory is read from /proc: peak and current RSS once calibration has loaded, and (with --stream-ms) RSS after a
+	data client has stopped reading for a while, so the send ring is full.
+
+	Output is one "name median" pair per line (ms, or kB for memory.*) so results can be compared between releases.
+ */
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "../../lib/xptools/Socket.h"
+
+using namespace std;
+
+typedef map<string, vector<double> > Results;
+
+static double Elapsed(chrono::steady_clock::time_point start);
+static unique_ptr<Socket> ConnectWithRetry(uint16_t port, chrono::seconds timeout);
+static bool SendCommand(Socket& sock, const string& cmd);
+static bool ReadLine(Socket& sock, string& line);
+static void ParseReport(const string& report, Results& results);
+static void ReadMemoryUsage(pid_t pid, const string& prefix, Results& results);
+static bool RunOnce(const string& bridge, uint16_t scpiPort, unsigned int streamMs, Results& results);
+static void help();
+
+static double Elapsed(chrono::steady_clock::time_point start)
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() * 1e-3;
+}
+
+/**
+	@brief Keeps trying to connect until the bridge is listening
+ */
+static unique_ptr<Socket> ConnectWithRetry(uint16_t port, chrono::seconds timeout)
+{
+	auto deadline = chrono::steady_clock::now() + timeout;
+	while(chrono::steady_clock::now() < deadline)
+	{
+		unique_ptr<Socket> sock(new Socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+		if(sock->Connect("127.0.0.1", port))
+		{
+			sock->DisableNagle();
+			return sock;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	return nullptr;
+}
+
+static bool SendCommand(Socket& sock, const string& cmd)
+{
+	string line = cmd + "\n";
+	return sock.SendLooped((const unsigned char*)line.c_str(), line.length());
+}
+
+static bool ReadLine(Socket& sock, string& line)
+{
+	line = "";
+	char c;
+	while(sock.RecvLooped((unsigned char*)&c, 1))
+	{
+		if(c == '\n')
+			return true;
+		line += c;
+	}
+	return false;
+}
+
+/**
+	@brief Adds the contents of a STARTUP? reply ("phase=ms,...;milestone=ms,...") to the results
+ */
+static void ParseReport(const string& report, Results& results)
+{
+	string field;
+	for(size_t i=0; i<=report.length(); i++)
+	{
+		if( (i < report.length()) && (report[i] != ',') && (report[i] != ';') )
+		{
+			field += report[i];
+			continue;
+		}
+
+		auto eq = field.find('=');
+		if(eq != string::npos)
+			results["bridge." + field.substr(0, eq)].push_back(atof(field.substr(eq+1).c_str()));
+		field = "";
+	}
+}
+
+/**
+	@brief Adds peak and current RSS of a process, in kB, to the results
+ */
+static void ReadMemoryUsage(pid_t pid, const string& prefix, Results& results)
+{
+	string path = "/proc/" + to_string(pid) + "/status";
+	FILE* fp = fopen(path.c_str(), "r");
+	if(!fp)
+		return;
+
+	char line[256];
+	unsigned long kb;
+	while(fgets(line, sizeof(line), fp))
+	{
+		if(1 == sscanf(line, "VmHWM: %lu kB", &kb))
+			results[prefix + "peak_kb"].push_back(kb);
+		else if(1 == sscanf(line, "VmRSS: %lu kB", &kb))
+			results[prefix + "rss_kb"].push_back(kb);
+	}
+	fclose(fp);
+}
+
+/**
+	@brief Starts the bridge, waits for the first frame and calibration, then shuts it down again
+ */
+static bool RunOnce(const string& bridge, uint16_t scpiPort, unsigned int streamMs, Results& results)
+{
+	auto start = chrono::steady_clock::now();
+
+	string scpiArg = to_string(scpiPort);
+	string waveformArg = to_string(scpiPort + 1);
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		perror("fork");
+		return false;
+	}
+	if(pid == 0)
+	{
+		//Keep the bridge's log out of our results
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		execl(bridge.c_str(), bridge.c_str(),
+			"--scpi-port", scpiArg.c_str(),
+			"--waveform-port", waveformArg.c_str(),
+			(char*)nullptr);
+		perror("exec");
+		_exit(1);
+	}
+
+	bool ok = false;
+	auto scpi = ConnectWithRetry(scpiPort, chrono::seconds(10));
+	if(scpi)
+	{
+		results["client.scpi_connect"].push_back(Elapsed(start));
+
+		//The data plane is only accepted once there's a control connection
+		auto data = ConnectWithRetry(scpiPort + 1, chrono::seconds(10));
+		unsigned char first;
+		string reply;
+		if(data && SendCommand(*scpi, "START") && data->RecvLooped(&first, 1))
+		{
+			results["client.first_frame"].push_back(Elapsed(start));
+
+			//*IDN? blocks until calibration has loaded
+			if(SendCommand(*scpi, "*IDN?") && ReadLine(*scpi, reply))
+			{
+				results["client.calibration"].push_back(Elapsed(start));
+				if(SendCommand(*scpi, "STARTUP?") && ReadLine(*scpi, reply))
+				{
+					ParseReport(reply, results);
+					ReadMemoryUsage(pid, "memory.", results);
+					ok = true;
+				}
+
+				//Stop reading, so frames back up in the socket buffers and send ring
+				if(ok && streamMs)
+				{
+					this_thread::sleep_for(chrono::milliseconds(streamMs));
+					ReadMemoryUsage(pid, "memory.backlog_", results);
+				}
+			}
+		}
+	}
+	if(!ok)
+		fprintf(stderr, "Run failed\n");
+
+	kill(pid, SIGTERM);
+	int status;
+	waitpid(pid, &status, 0);
+	return ok;
+}
+
+static void help()
+{
+	fprintf(stderr,
+			"startup-benchmark [--runs count] [--port port] [--stream-ms ms] path/to/specbridge-mock\n"
+			"\n"
+			"  --runs        Number of times to start the bridge (default 10)\n"
+			"  --port        SCPI port to use; the data plane uses the next one up (default 15025)\n"
+			"  --stream-ms   Let frames back up for this long after startup and measure memory again (default 0)\n"
+			"\n"
+			"Set MOCK_SPECTROMETER_* environment variables to change the simulated USB timing.\n"
+	);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int runs = 10;
+	uint16_t port = 15025;
+	unsigned int streamMs = 0;
+	string bridge;
+	for(int i=1; i<argc; i++)
+	{
+		string s(argv[i]);
+		if( (s == "--runs") && (i+1 < argc) )
+			runs = atoi(argv[++i]);
+		else if( (s == "--port") && (i+1 < argc) )
+			port = atoi(argv[++i]);
+		else if( (s == "--stream-ms") && (i+1 < argc) )
+			streamMs = atoi(argv[++i]);
+		else if(s[0] != '-')
+			bridge = s;
+		else
+		{
+			help();
+			return 1;
+		}
+	}
+	if(bridge.empty())
+	{
+		help();
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	Results results;
+	unsigned int failures = 0;
+	for(unsigned int i=0; i<runs; i++)
+	{
+		if(!RunOnce(bridge, port, streamMs, results))
+			failures ++;
+	}
+
+	//Report medians
+	for(auto& it : results)
+	{
+		auto& v = it.second;
+		sort(v.begin(), v.end());
+		printf("%s %.1f\n", it.first.c_str(), v[v.size()/2]);
+	}
+	printf("runs %u\n", runs);
+	printf("failures %u\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,423 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Software stand-in for libspectrometer, for benchmarking the bridge without hardware
+
+	Implements the parts of the ASEQ API the bridge uses against a simulated device with one spectrometer on the bus.
+	Exposures take real time, the flash holds well-formed calibration text, and USB costs can be dialled in with
+	environment variables so startup numbers look like the real thing:
+
+		MOCK_SPECTROMETER_ENUM_MS		Time taken to enumerate devices (default 20)
+		MOCK_SPECTROMETER_CONNECT_MS	Time taken to open the device (default 50)
+		MOCK_SPECTROMETER_LATENCY_US	Round trip time of each USB command (default 250)
+		MOCK_SPECTROMETER_FLASH_KBPS	Flash read throughput in kB/s (default 64)
+		MOCK_SPECTROMETER_FRAME_US		Time taken to read out one frame (default 2000)
+ */
+
+#include <libspectrometer.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+//Sensor geometry, matches the 3653 pixel devices the bridge expects
+#define MOCK_PIXELS			3653
+#define MOCK_DUMMY_BEFORE	32
+#define MOCK_DUMMY_AFTER	14
+#define MOCK_FRAME_SIZE		(MOCK_DUMMY_BEFORE + MOCK_PIXELS + MOCK_DUMMY_AFTER)
+#define MOCK_FLASH_SIZE		(128 * 1024)
+#define MOCK_FRAME_MEMORY	64
+
+//Anything non-zero will do as a context
+#define MOCK_CONTEXT		0x5eca
+
+static unsigned int GetTiming(const char* name, unsigned int def);
+static void Delay(chrono::microseconds us);
+static void UsbRoundTrip();
+static void InitFlash();
+static bool IsOpen(uintptr_t* deviceContextPtr);
+static unsigned int FramesCompleted();
+
+/**
+	@brief State of the simulated device
+ */
+class MockDevice
+{
+public:
+	MockDevice()
+		: m_connected(false)
+		, m_scans(1)
+		, m_exposure(100)
+		, m_framesAcquired(0)
+		, m_framesRead(0)
+		, m_acquiring(false)
+	{}
+
+	bool m_connected;
+
+	//Acquisition settings
+	unsigned int m_scans;
+	uint32_t m_exposure;
+
+	//Frames captured since the last trigger or clear, and how many of those have been read out
+	unsigned int m_framesAcquired;
+	unsigned int m_framesRead;
+
+	//Time of the last trigger, if scans from it may still be in progress
+	bool m_acquiring;
+	chrono::steady_clock::time_point m_triggerTime;
+
+	vector<uint8_t> m_flash;
+};
+
+static mutex g_mockMutex;
+static MockDevice g_mock;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+/**
+	@brief Reads a timing override from the environment
+ */
+static unsigned int GetTiming(const char* name, unsigned int def)
+{
+	auto value = getenv(name);
+	if(!value)
+		return def;
+	return strtoul(value, nullptr, 10);
+}
+
+static void Delay(chrono::microseconds us)
+{
+	if(us.count() > 0)
+		this_thread::sleep_for(us);
+}
+
+static void UsbRoundTrip()
+{
+	Delay(chrono::microseconds(GetTiming("MOCK_SPECTROMETER_LATENCY_US", 250)));
+}
+
+/**
+	@brief Fills the flash with calibration data in the same layout as a real device
+
+	Line 1 is "model c.N serial", line 2 the absolute calibration coefficient, and the wavelength table starts on
+	line 13. A blank line separates it from the sensor response table.
+ */
+static void InitFlash()
+{
+	if(!g_mock.m_flash.empty())
+		return;
+
+	string text = "LR1-MOCK c.N MOCK0001\r\n1.0\r\n";
+	for(int i=2; i<12; i++)
+		text += "0\r\n";
+
+	char line[32];
+	for(int i=0; i<MOCK_PIXELS; i++)
+	{
+		snprintf(line, sizeof(line), "%.3f\r\n", 200.0 + i*0.25);
+		text += line;
+	}
+	text += "\r\n";
+	for(int i=0; i<MOCK_PIXELS; i++)
+	{
+		snprintf(line, sizeof(line), "%.6f\r\n", 0.8 + 0.2*sin(i * M_PI / MOCK_PIXELS));
+		text += line;
+	}
+
+	//Unused flash reads back as zeroes
+	g_mock.m_flash.resize(MOCK_FLASH_SIZE, 0);
+	memcpy(&g_mock.m_flash[0], text.c_str(), min(text.length(), g_mock.m_flash.size() - 1));
+}
+
+/**
+	@brief Number of scans from the last trigger that have finished exposing. Call with g_mockMutex held.
+ */
+static unsigned int FramesCompleted()
+{
+	if(!g_mock.m_acquiring)
+		return g_mock.m_framesAcquired;
+
+	//Exposure is in 10us units
+	auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - g_mock.m_triggerTime);
+	auto exposure = max(1u, g_mock.m_exposure) * 10;
+	unsigned int done = min((unsigned int)(elapsed.count() / exposure), g_mock.m_scans);
+	if(done == g_mock.m_scans)
+		g_mock.m_acquiring = false;
+
+	g_mock.m_framesAcquired = min(done, (unsigned int)MOCK_FRAME_MEMORY);
+	return g_mock.m_framesAcquired;
+}
+
+static bool IsOpen(uintptr_t* deviceContextPtr)
+{
+	return deviceContextPtr && (*deviceContextPtr == MOCK_CONTEXT) && g_mock.m_connected;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Device management
+
+int getDevicesCount()
+{
+	return 1;
+}
+
+DeviceInfo_t* getDevicesInfo()
+{
+	Delay(chrono::milliseconds(GetTiming("MOCK_SPECTROMETER_ENUM_MS", 20)));
+
+	auto info = new DeviceInfo_t;
+	memset(info, 0, sizeof(DeviceInfo_t));
+	strncpy(info->serialNumber, "MOCK0001", sizeof(info->serialNumber) - 1);
+	info->next = nullptr;
+	return info;
+}
+
+void clearDevicesInfo(DeviceInfo_t* info)
+{
+	while(info)
+	{
+		auto next = info->next;
+		delete info;
+		info = next;
+	}
+}
+
+int connectToDeviceByIndex(unsigned int index, uintptr_t* deviceContextPtr)
+{
+	if(index != 0)
+		return CONNECT_ERROR_FAILED;
+
+	Delay(chrono::milliseconds(GetTiming("MOCK_SPECTROMETER_CONNECT_MS", 50)));
+
+	lock_guard<mutex> lock(g_mockMutex);
+	InitFlash();
+	g_mock.m_connected = true;
+	g_mock.m_framesAcquired = 0;
+	g_mock.m_framesRead = 0;
+	g_mock.m_acquiring = false;
+	*deviceContextPtr = MOCK_CONTEXT;
+	return 0;
+}
+
+int connectToDeviceBySerial(const char* serialNumber, uintptr_t* deviceContextPtr)
+{
+	if(strcmp(serialNumber, "MOCK0001") != 0)
+		return CONNECT_ERROR_FAILED;
+	return connectToDeviceByIndex(0, deviceContextPtr);
+}
+
+int disconnectDeviceContext(uintptr_t* deviceContextPtr)
+{
+	lock_guard<mutex> lock(g_mockMutex);
+	g_mock.m_connected = false;
+	*deviceContextPtr = 0;
+	return 0;
+}
+
+int resetDevice(uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr))
+		return -1;
+	g_mock.m_scans = 1;
+	g_mock.m_framesAcquired = 0;
+	g_mock.m_framesRead = 0;
+	g_mock.m_acquiring = false;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+int setAcquisitionParameters(
+	uint16_t numOfScans,
+	uint16_t /*numOfBlankScans*/,
+	uint8_t /*scanMode*/,
+	uint32_t timeOfExposure,
+	uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr) || (numOfScans == 0) || (numOfScans > MOCK_FRAME_MEMORY) )
+		return -1;
+	g_mock.m_scans = numOfScans;
+	g_mock.m_exposure = timeOfExposure;
+	return 0;
+}
+
+int setFrameFormat(
+	uint16_t numOfStartElement,
+	uint16_t numOfEndElement,
+	uint8_t /*reductionMode*/,
+	uint16_t* numOfPixelsInFrame,
+	uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr) || (numOfEndElement < numOfStartElement) )
+		return -1;
+	*numOfPixelsInFrame = numOfEndElement - numOfStartElement + 1;
+	return 0;
+}
+
+int setExposure(uint32_t timeOfExposure, uint8_t /*force*/, uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr))
+		return -1;
+	g_mock.m_exposure = timeOfExposure;
+	return 0;
+}
+
+int setExternalTrigger(uint8_t enableMode, uint8_t /*signalFrontMode*/, uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	//There's nothing to trigger us externally
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr) || enableMode)
+		return -1;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Acquisition
+
+int triggerAcquisition(uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr))
+		return -1;
+	g_mock.m_framesAcquired = 0;
+	g_mock.m_framesRead = 0;
+	g_mock.m_acquiring = true;
+	g_mock.m_triggerTime = chrono::steady_clock::now();
+	return 0;
+}
+
+int getStatus(uint8_t* statusFlags, uint16_t* framesInMemory, uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr))
+		return -1;
+	auto completed = FramesCompleted();
+	*statusFlags = g_mock.m_acquiring ? 1 : 0;
+	*framesInMemory = completed - g_mock.m_framesRead;
+	return 0;
+}
+
+int getFrame(uint16_t* framePixelsBuffer, uint16_t /*numOfFrame*/, uintptr_t* deviceContextPtr)
+{
+	//Like the real thing, block until the exposure we're reading has finished
+	while(true)
+	{
+		{
+			lock_guard<mutex> lock(g_mockMutex);
+			if(!IsOpen(deviceContextPtr))
+				return -1;
+			if(FramesCompleted() > g_mock.m_framesRead)
+			{
+				g_mock.m_framesRead ++;
+				break;
+			}
+			if(!g_mock.m_acquiring)
+				return -1;
+		}
+		this_thread::sleep_for(chrono::microseconds(100));
+	}
+
+	Delay(chrono::microseconds(GetTiming("MOCK_SPECTROMETER_FRAME_US", 2000)));
+
+	//A couple of emission lines on a dark floor, scaled by exposure so EXPOSURE changes are visible
+	double scale;
+	{
+		lock_guard<mutex> lock(g_mockMutex);
+		scale = min(1.0, g_mock.m_exposure / 10000.0);
+	}
+	for(int i=0; i<MOCK_FRAME_SIZE; i++)
+	{
+		double value = 1000;
+		if( (i >= MOCK_DUMMY_BEFORE) && (i < MOCK_DUMMY_BEFORE + MOCK_PIXELS) )
+		{
+			double x = i - MOCK_DUMMY_BEFORE;
+			value += scale * (40000 * exp(-pow((x - 1200) / 8, 2)) + 25000 * exp(-pow((x - 2500) / 15, 2)));
+			value += rand() % 16;
+		}
+		framePixelsBuffer[i] = min(65535.0, value);
+	}
+	return 0;
+}
+
+int clearMemory(uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr))
+		return -1;
+	g_mock.m_framesAcquired = 0;
+	g_mock.m_framesRead = 0;
+	g_mock.m_acquiring = false;
+	return 0;
+}
+
+int readFlash(uint8_t* buffer, uint32_t absoluteOffset, uint32_t bytesToRead, uintptr_t* deviceContextPtr)
+{
+	UsbRoundTrip();
+	auto kbps = max(1u, GetTiming("MOCK_SPECTROMETER_FLASH_KBPS", 64));
+	Delay(chrono::microseconds(bytesToRead * 1000ULL / kbps));
+
+	lock_guard<mutex> lock(g_mockMutex);
+	if(!IsOpen(deviceContextPtr) || ( (uint64_t)absoluteOffset + bytesToRead > g_mock.m_flash.size()) )
+		return -1;
+	memcpy(buffer, &g_mock.m_flash[absoluteOffset], bytesToRead);
+	return 0;
+}
@@ -0,0 +1,616 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of AcquisitionEngine
+ */
+
+#include "specbridge.h"
+#include "Acquisition.h"
+#include "EventCapture.h"
+#include "FastMath.h"
+#include <math.h>
+
+using namespace std;
+
+volatile AcquisitionMode g_acquisitionMode = ACQ_TRIGGERED;
+
+//Scans per trigger in continuous mode
+volatile unsigned int g_burstFrames = 16;
+
+//Time between triggers, in ns (0 to run as fast as the device can)
+static atomic<int64_t> g_framePeriod(0);
+
+//Range of target frame rates, in Hz. Keeps the period well inside an int64_t of ns and above zero.
+#define MIN_FRAME_RATE	1e-6
+#define MAX_FRAME_RATE	1e6
+
+//Recent average USB readout time per frame, in ns (0 until the first frame)
+static atomic<int64_t> g_readoutTime(0);
+
+//Set once the device has shown it can't read out one frame while exposing the next, so PIPELINED runs as TRIGGERED.
+//The configured mode is left alone. Cleared when the device is re-opened, since it may be a different one.
+static atomic<bool> g_pipelinedFallback(false);
+
+static chrono::nanoseconds GetFramePeriod();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Mode names
+
+/**
+	@brief Converts a mode name (as used on the command line and in SCPI) to an AcquisitionMode
+
+	@return False if the name is not recognized
+ */
+bool ParseAcquisitionMode(const string& name, AcquisitionMode& mode)
+{
+	if( (name == "TRIGGERED") || (name == "triggered") )
+		mode = ACQ_TRIGGERED;
+	else if( (name == "PIPELINED") || (name == "pipelined") )
+		mode = ACQ_PIPELINED;
+	else if( (name == "CONTINUOUS") || (name == "continuous") )
+		mode = ACQ_CONTINUOUS;
+	else
+		return false;
+	return true;
+}
+
+string GetAcquisitionModeName(AcquisitionMode mode)
+{
+	switch(mode)
+	{
+		case ACQ_PIPELINED:
+			return "PIPELINED";
+
+		case ACQ_CONTINUOUS:
+			return "CONTINUOUS";
+
+		case ACQ_TRIGGERED:
+		default:
+			return "TRIGGERED";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Frame rate
+
+/**
+	@brief Sets the target frame rate
+
+	@param hz	Frames per second, or zero to acquire as fast as possible
+
+	@return False if the rate is not a number, or neither zero nor between 1 uHz and 1 MHz
+ */
+bool SetFrameRate(double hz)
+{
+	if(!IsFiniteValue(hz))
+		return false;
+	if( (hz != 0) && ( (hz < MIN_FRAME_RATE) || (hz > MAX_FRAME_RATE) ) )
+		return false;
+
+	g_framePeriod = (hz > 0) ? llround(1e9 / hz) : 0;
+
+	double limit = GetMaxFrameRate();
+	if( (hz > limit) && (limit > 0) )
+		LogVerbose("Frame rate %.3f Hz is above the %.3f Hz the current exposure allows\n", hz, limit);
+	return true;
+}
+
+/**
+	@brief Returns the target frame rate, or zero if free-running
+ */
+double GetFrameRate()
+{
+	int64_t period = g_framePeriod;
+	return period ? 1e9 / period : 0;
+}
+
+/**
+	@brief Estimates the fastest frame rate the device can sustain with the current exposure and acquisition mode
+
+	Readout time is measured from recent frames, so the estimate is optimistic until some have been acquired.
+ */
+double GetMaxFrameRate()
+{
+	double exposure = g_exposure * 1e-5;
+	double readout = g_readoutTime * 1e-9;
+
+	//Only triggered mode leaves the sensor idle during readout
+	AcquisitionMode mode = g_acquisitionMode;
+	bool triggered = (mode == ACQ_TRIGGERED) || ( (mode == ACQ_PIPELINED) && g_pipelinedFallback);
+	double frameTime = triggered ? exposure + readout : max(exposure, readout);
+	return (frameTime > 0) ? 1 / frameTime : 0;
+}
+
+/**
+	@brief Checks if PIPELINED mode is running as TRIGGERED because the device can't overlap exposure and readout
+ */
+bool IsPipelinedFallback()
+{
+	return g_pipelinedFallback;
+}
+
+static chrono::nanoseconds GetFramePeriod()
+{
+	return chrono::nanoseconds(g_framePeriod);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Trigger control (shared by the SCPI and binary control servers)
+
+/**
+	@brief Arms the trigger, for one frame or continuously
+ */
+void StartAcquisition(bool oneShot)
+{
+	g_triggerArmed = true;
+	g_triggerOneShot = oneShot;
+}
+
+void StopAcquisition()
+{
+	g_triggerArmed = false;
+}
+
+/**
+	@brief Arms the trigger, and in event capture mode also fires the software trigger
+ */
+void ForceTrigger()
+{
+	g_triggerArmed = true;
+	if(g_eventCapture)
+		FireEvent();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+AcquisitionEngine::AcquisitionEngine()
+	: m_mode(g_acquisitionMode)
+	, m_scanCount(1)
+	, m_scanExposure(g_exposure)
+	, m_rejectedBurst(0)
+	, m_pipelineVerified(false)
+	, m_framesPending(0)
+	, m_scheduledScans(0)
+{
+}
+
+AcquisitionEngine::~AcquisitionEngine()
+{
+	Idle();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Acquisition
+
+/**
+	@brief Gets the next frame from the device
+
+	@return False on a device error
+ */
+bool AcquisitionEngine::AcquireFrame(Frame& frame)
+{
+	frame.m_raw.resize(Frame::RAW_SIZE);
+
+	//A single capture in continuous mode is just a triggered capture, no point in running a whole burst
+	AcquisitionMode mode = g_acquisitionMode;
+	if( (mode == ACQ_CONTINUOUS) && g_triggerOneShot)
+		mode = ACQ_TRIGGERED;
+	if( (mode == ACQ_PIPELINED) && g_pipelinedFallback)
+		mode = ACQ_TRIGGERED;
+
+	//Changing modes: finish whatever the old mode left running
+	if(mode != m_mode)
+	{
+		Idle();
+		m_mode = mode;
+	}
+
+	switch(mode)
+	{
+		case ACQ_PIPELINED:
+			return AcquirePipelined(frame);
+
+		case ACQ_CONTINUOUS:
+			return AcquireContinuous(frame);
+
+		case ACQ_TRIGGERED:
+		default:
+			return AcquireTriggered(frame);
+	}
+}
+
+/**
+	@brief Stops anything left running, so stale frames aren't delivered when acquisition resumes
+
+	Also puts the device back in single-scan mode if we were in continuous mode.
+ */
+void AcquisitionEngine::Idle()
+{
+	m_drained.clear();
+
+	if(m_framesPending)
+	{
+		WaitForFrames(m_framesPending);
+		m_framesPending = 0;
+
+		lock_guard<mutex> lock(g_mutex);
+		int err;
+		if(0 != (err = clearMemory(&g_hDevice)))
+			LogError("failed to clear frame memory, code %d\n", err);
+	}
+
+	//If the device has gone away this fails every time, and we're called about once a millisecond while idle.
+	//Only retry once a second. Reset() clears the backoff once the device has been re-opened.
+	auto now = chrono::steady_clock::now();
+	if( (m_scanCount != 1) && (now >= m_scanCountRetry) )
+	{
+		if(!SetScanCount(1))
+			m_scanCountRetry = now + chrono::seconds(1);
+	}
+}
+
+/**
+	@brief Forgets everything we thought the device was doing, without talking to it
+
+	Used after the device has been re-opened, which leaves it idle and in single-scan mode.
+ */
+void AcquisitionEngine::Reset()
+{
+	m_drained.clear();
+	m_framesPending = 0;
+	m_scanCount = 1;
+	m_scanExposure = g_exposure;
+	m_rejectedBurst = 0;
+	m_pipelineVerified = false;
+	m_scanCountRetry = chrono::steady_clock::time_point();
+	g_pipelinedFallback = false;
+}
+
+bool AcquisitionEngine::AcquireTriggered(Frame& frame)
+{
+	lock_guard<mutex> lock(g_mutex);
+
+	//Trigger an acquisition
+	int err;
+	if(0 != (err = triggerAcquisition(&g_hDevice)))
+		LogError("failed to trigger acquisition, code %d\n", err);
+	OnTriggered(1);
+
+	//Get the frame data
+	if(!ReadFrame(frame, m_triggerClocks, 0))
+		return false;
+
+	if(g_triggerOneShot)
+		g_triggerArmed = false;
+	return true;
+}
+
+bool AcquisitionEngine::AcquirePipelined(Frame& frame)
+{
+	//Normally the exposure for this frame was started while we were reading out the last one
+	if(!m_framesPending && !Trigger(1))
+		return false;
+
+	if(!WaitForFrames(1))
+		return false;
+	m_framesPending = 0;
+
+	bool oneShot = g_triggerOneShot;
+	if(oneShot)
+		g_triggerArmed = false;
+
+	{
+		lock_guard<mutex> lock(g_mutex);
+
+		//Start the next exposure before reading this one out, so the sensor integrates during USB transfer
+		//and processing. Not for one-shot captures, since nobody asked for another frame, and not if the frame
+		//rate says it isn't time yet (the data thread triggers it when it is).
+		ClockSample thisTrigger = m_triggerClocks;
+		if(!oneShot && IsTriggerDue())
+		{
+			int err;
+			if(0 != (err = triggerAcquisition(&g_hDevice)))
+				LogError("failed to trigger acquisition, code %d\n", err);
+			else
+			{
+				m_framesPending = 1;
+				OnTriggered(1);
+			}
+		}
+
+		bool overlapped = (m_framesPending != 0);
+		if(ReadFrame(frame, thisTrigger, 0))
+		{
+			if(overlapped)
+				m_pipelineVerified = true;
+			return true;
+		}
+
+		//Anything other than the first overlapped readout failing is an ordinary device error, for recovery to handle
+		if(!overlapped || m_pipelineVerified)
+			return false;
+	}
+
+	//Not all firmware can read out one frame while exposing the next. If the device is otherwise fine, that's what
+	//happened: run as triggered rather than ending the session.
+	if(!IsDeviceResponding())
+		return false;
+	LogWarning("Device can't read out while exposing, running PIPELINED mode as TRIGGERED\n");
+	Idle();
+	g_pipelinedFallback = true;
+	m_mode = ACQ_TRIGGERED;
+	return AcquireTriggered(frame);
+}
+
+bool AcquisitionEngine::AcquireContinuous(Frame& frame)
+{
+	//Hand out frames we already have before talking to the device again
+	if(m_drained.empty())
+	{
+		//Start a new burst. The scan count is only changed here since the device must be idle to change it.
+		if(!m_framesPending)
+		{
+			unsigned int burst = GetBurstSize();
+			if( (burst != m_scanCount) || (m_scanExposure != g_exposure) )
+			{
+				if(!SetScanCount(burst))
+				{
+					//A device that still answers turned the setting down rather than going away. That's a
+					//configuration problem, not a reason to recover the device: keep the burst size it has.
+					if( (burst == m_scanCount) || !IsDeviceResponding() )
+						return false;
+					LogError("Device rejected a burst of %u scans, continuing with %u\n", burst, m_scanCount);
+					m_rejectedBurst = burst;
+					burst = m_scanCount;
+					if( (m_scanExposure != g_exposure) && !SetScanCount(burst) )
+						return false;
+				}
+			}
+			if(!Trigger(burst))
+				return false;
+		}
+
+		//Let the whole burst land in device memory, so it only costs one status poll
+		if(!WaitForFrames(m_framesPending))
+			return false;
+
+		lock_guard<mutex> lock(g_mutex);
+		unsigned int count = m_framesPending;
+		m_framesPending = 0;
+		ClockSample burstTrigger = m_triggerClocks;
+
+		//Start the next burst before reading this one out so the sensor never sits idle.
+		//If the burst size or exposure changed, leave it to the next call to reconfigure and trigger.
+		int err;
+		bool reconfigure = (GetBurstSize() != m_scanCount) || (g_exposure != m_scanExposure);
+		if(g_triggerArmed && !g_triggerOneShot && !g_waveformThreadQuit && !reconfigure && IsTriggerDue())
+		{
+			if(0 != (err = triggerAcquisition(&g_hDevice)))
+				LogError("failed to trigger acquisition, code %d\n", err);
+			else
+			{
+				m_framesPending = m_scanCount;
+				OnTriggered(m_scanCount);
+			}
+		}
+
+		for(unsigned int i=0; i<count; i++)
+		{
+			m_drained.push_back(Frame());
+			if(!ReadFrame(m_drained.back(), burstTrigger, i))
+				return false;
+		}
+	}
+
+	uint64_t sequence = frame.m_sequence;
+	frame = move(m_drained.front());
+	frame.m_sequence = sequence;
+	m_drained.pop_front();
+	return true;
+}
+
+/**
+	@brief Starts an acquisition of the given number of scans, without waiting for it
+ */
+bool AcquisitionEngine::Trigger(unsigned int scans)
+{
+	lock_guard<mutex> lock(g_mutex);
+
+	int err;
+	if(0 != (err = triggerAcquisition(&g_hDevice)))
+	{
+		LogError("failed to trigger acquisition, code %d\n", err);
+		return false;
+	}
+
+	m_framesPending = scans;
+	OnTriggered(scans);
+	return true;
+}
+
+/**
+	@brief Returns when the frame rate allows the next trigger
+
+	Frames that are already exposing or have been drained from the device are ready now, so this is only in the
+	future when the next frame needs a new trigger.
+ */
+chrono::steady_clock::time_point AcquisitionEngine::GetNextTriggerTime() const
+{
+	if(m_framesPending || !m_drained.empty())
+		return chrono::steady_clock::time_point();
+	return m_scheduled + GetFramePeriod()*m_scheduledScans;
+}
+
+/**
+	@brief True if the frame rate allows a new trigger now
+ */
+bool AcquisitionEngine::IsTriggerDue() const
+{
+	return chrono::steady_clock::now() >= m_scheduled + GetFramePeriod()*m_scheduledScans;
+}
+
+/**
+	@brief Records the time of a trigger we just issued, and assigns it a slot in the frame rate schedule
+
+	@param scans	Number of scans the trigger started
+ */
+void AcquisitionEngine::OnTriggered(unsigned int scans)
+{
+	m_triggerTime = chrono::steady_clock::now();
+	m_triggerClocks = SampleClocks();
+
+	//Slots are spaced from the previous slot rather than from when we actually woke up, so timer overshoot doesn't
+	//accumulate as drift. If we've fallen a whole period behind (acquisition was paused, or the rate isn't
+	//achievable) start over from now instead of firing a run of catch-up triggers.
+	auto period = GetFramePeriod();
+	auto due = m_scheduled + period*m_scheduledScans;
+	if(m_triggerTime - due >= period)
+		m_scheduled = m_triggerTime;
+	else
+		m_scheduled = due;
+	m_scheduledScans = scans;
+}
+
+/**
+	@brief Reads the oldest frame out of device memory and timestamps it. Must be called with g_mutex held.
+
+	@param frame	Frame to read into
+	@param trigger	Host clocks at the trigger that started this frame's acquisition
+	@param index	Position of this frame in the burst started by that trigger (zero if only one scan per trigger)
+ */
+bool AcquisitionEngine::ReadFrame(Frame& frame, const ClockSample& trigger, unsigned int index)
+{
+	frame.m_raw.resize(Frame::RAW_SIZE);
+	frame.m_exposure = g_exposure;
+	frame.m_trigger = trigger;
+
+	//Scans in a burst are back to back, so the Nth one is centered N+1/2 exposures after the trigger
+	int64_t exposure = frame.m_exposure * 10000LL;
+	frame.m_midExposure = trigger.m_mono + index*exposure + exposure/2;
+
+	frame.m_readoutStart = GetMonotonicTime();
+	int err = getFrame(&frame.m_raw[0], 0xffff, &g_hDevice);
+	frame.m_readoutEnd = GetMonotonicTime();
+	if(err != 0)
+	{
+		LogError("failed to get frame, code %d\n", err);
+		return false;
+	}
+
+	//Track readout time for GetMaxFrameRate()
+	int64_t readout = frame.m_readoutEnd - frame.m_readoutStart;
+	int64_t average = g_readoutTime;
+	g_readoutTime = average ? (average*7 + readout) / 8 : readout;
+	return true;
+}
+
+/**
+	@brief Configures the number of back-to-back scans the device takes per trigger
+ */
+bool AcquisitionEngine::SetScanCount(unsigned int scans)
+{
+	lock_guard<mutex> lock(g_mutex);
+
+	int err;
+	if(0 != (err = setAcquisitionParameters(scans, 0, 0, g_exposure, &g_hDevice)))
+	{
+		LogError("failed to set acquisition parameters, code %d\n", err);
+		return false;
+	}
+
+	m_scanCount = scans;
+	m_scanExposure = g_exposure;
+	return true;
+}
+
+/**
+	@brief Number of scans per burst to configure for the next burst in CONTINUOUS mode
+ */
+unsigned int AcquisitionEngine::GetBurstSize() const
+{
+	unsigned int burst = min(max(1u, (unsigned int)g_burstFrames), (unsigned int)MAX_BURST_FRAMES);
+	if(burst == m_rejectedBurst)
+		return m_scanCount;
+	return burst;
+}
+
+/**
+	@brief Checks if the device still answers a status request, to tell a rejected setting from a lost device
+ */
+bool AcquisitionEngine::IsDeviceResponding()
+{
+	lock_guard<mutex> lock(g_mutex);
+	uint8_t flags;
+	uint16_t framesInMemory;
+	return (0 == getStatus(&flags, &framesInMemory, &g_hDevice));
+}
+
+/**
+	@brief Waits until at least the given number of frames from the last trigger are in the device's frame memory
+
+	@return False on a device error or timeout
+ */
+bool AcquisitionEngine::WaitForFrames(unsigned int count)
+{
+	//No point asking the device before the exposures can possibly be over.
+	//Don't hold the mutex while sleeping so the control plane stays responsive.
+	auto exposure = chrono::microseconds(g_exposure * 10);
+	auto framesTaken = (m_scanCount - m_framesPending) + count;
+	this_thread::sleep_until(m_triggerTime + exposure*framesTaken);
+
+	auto deadline = m_triggerTime + exposure*framesTaken + chrono::seconds(1);
+	while(true)
+	{
+		uint8_t flags;
+		uint16_t framesInMemory;
+		int err;
+		{
+			lock_guard<mutex> lock(g_mutex);
+			err = getStatus(&flags, &framesInMemory, &g_hDevice);
+		}
+		if(err != 0)
+		{
+			LogError("failed to get status, code %d\n", err);
+			return false;
+		}
+		if(framesInMemory >= count)
+			return true;
+
+		if(chrono::steady_clock::now() > deadline)
+		{
+			LogError("timed out waiting for exposure to complete\n");
+			return false;
+		}
+		this_thread::sleep_for(chrono::microseconds(100));
+	}
+}
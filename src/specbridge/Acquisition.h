@@ -0,0 +1,144 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of AcquisitionEngine
+ */
+
+#ifndef Acquisition_h
+#define Acquisition_h
+
+#include "Frame.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+
+/**
+	@brief How frames are requested from the device
+ */
+enum AcquisitionMode
+{
+	///@brief Trigger, wait for the exposure, read out, repeat. Sensor is idle during readout and processing.
+	ACQ_TRIGGERED,
+
+	///@brief Trigger the next exposure as soon as the current one ends, so it integrates during readout
+	ACQ_PIPELINED,
+
+	///@brief Let the device free-run a burst of back-to-back scans into its own memory, and drain them in batches
+	ACQ_CONTINUOUS
+};
+
+///@brief Scans the device's internal frame memory holds, so the largest burst CONTINUOUS mode can ask for
+#define MAX_BURST_FRAMES 64
+
+extern volatile AcquisitionMode g_acquisitionMode;
+extern volatile unsigned int g_burstFrames;
+
+bool ParseAcquisitionMode(const std::string& name, AcquisitionMode& mode);
+std::string GetAcquisitionModeName(AcquisitionMode mode);
+
+bool IsPipelinedFallback();
+
+bool SetFrameRate(double hz);
+double GetFrameRate();
+double GetMaxFrameRate();
+
+void StartAcquisition(bool oneShot);
+void StopAcquisition();
+void ForceTrigger();
+
+/**
+	@brief Pulls frames from the device according to the current acquisition mode
+
+	One instance is owned by each data thread. It may leave an exposure running between calls to AcquireFrame(),
+	so call Idle() whenever acquisition is paused.
+ */
+class AcquisitionEngine
+{
+public:
+	AcquisitionEngine();
+	~AcquisitionEngine();
+
+	bool AcquireFrame(Frame& frame);
+	void Idle();
+	void Reset();
+
+	std::chrono::steady_clock::time_point GetNextTriggerTime() const;
+
+protected:
+	bool AcquireTriggered(Frame& frame);
+	bool AcquirePipelined(Frame& frame);
+	bool AcquireContinuous(Frame& frame);
+
+	bool Trigger(unsigned int scans);
+	bool IsTriggerDue() const;
+	void OnTriggered(unsigned int scans);
+	bool ReadFrame(Frame& frame, const ClockSample& trigger, unsigned int index);
+	bool WaitForFrames(unsigned int count);
+	bool SetScanCount(unsigned int scans);
+	unsigned int GetBurstSize() const;
+	bool IsDeviceResponding();
+
+	///@brief Mode we were in as of the last frame
+	AcquisitionMode m_mode;
+
+	///@brief Number of scans the device is currently configured to take per trigger
+	unsigned int m_scanCount;
+
+	///@brief Exposure time the device was configured with in the last call to setAcquisitionParameters()
+	uint32_t m_scanExposure;
+
+	///@brief Burst size the device turned down, not asked for again until BURST changes (0 if none)
+	unsigned int m_rejectedBurst;
+
+	///@brief True once an overlapped readout has worked in PIPELINED mode, so later failures are device errors
+	bool m_pipelineVerified;
+
+	///@brief Earliest time Idle() may try again to put the device back in single-scan mode after a failure
+	std::chrono::steady_clock::time_point m_scanCountRetry;
+
+	///@brief Number of frames we've triggered that have not been read out yet
+	unsigned int m_framesPending;
+
+	///@brief When the last trigger was issued
+	std::chrono::steady_clock::time_point m_triggerTime;
+	ClockSample m_triggerClocks;
+
+	///@brief Slot in the frame rate schedule the last trigger was assigned to, and how many scans it started
+	std::chrono::steady_clock::time_point m_scheduled;
+	unsigned int m_scheduledScans;
+
+	///@brief Frames drained from the device in continuous mode but not returned by AcquireFrame() yet
+	std::deque<Frame> m_drained;
+};
+
+#endif
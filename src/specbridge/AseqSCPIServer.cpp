@@ -32,8 +32,15 @@
 	@author Andrew D. Zonenberg
 	@brief SCPI server. Control plane traffic only, no waveform data.
 
+	Automation that changes settings every frame can use the binary control protocol instead (see
+	BinaryControlServer.h), which covers trigger control, exposure, acquisition mode and status.
+
 	SCPI commands supported:
 
+		Calibration is read from the spectrometer in the background after startup. *IDN?, WAVELENGTHS?, FLATCAL?,
+		IRRCOEFF?, IRRCAL?, PIPE:WAVELENGTHS? and commands that change the pipeline wait for it to finish loading;
+		everything else (including streaming with the default pipeline) works immediately.
+
 		*IDN?
 			Returns a standard SCPI instrument identification string
 
@@ -51,11 +58,275 @@
 
 		IRRCAL?
 			Returns irradiance correction data (block 3 of cal file)
+
+		NLCORR?
+			Returns a description of the active detector nonlinearity correction
+
+		NLCORR:POLY c0,c1,c2...
+			Sets nonlinearity correction to corrected = c0 + c1*raw + c2*raw^2 + ...
+
+		NLCORR:TABLE raw0,corrected0,raw1,corrected1...
+			Sets nonlinearity correction to piecewise linear interpolation between the given points
+
+		NLCORR:IDENTITY
+			Disables nonlinearity correction
+
+		PIPE:ADD stage[,param1,param2...]
+			Appends a stage to the per-frame processing pipeline. Stages are:
+				NONLIN						Detector nonlinearity correction (first stage only)
+				DARK						Subtract dark frame (see DARK:CAPTURE)
+				FLAT						Divide by flatness calibration
+				IRR							Convert to absolute irradiance, normalized to exposure time
+				SMOOTH,width				Boxcar average over an odd number of points
+				RESAMPLE,start,stop,step	Interpolate onto a uniform wavelength grid (nm)
+				BIN,width					Average groups of adjacent points
+				REDUCE,lo,hi[,lo,hi...]		Mean value within each wavelength band (nm)
+			Adjacent elementwise stages (NONLIN, DARK, FLAT, IRR) are fused into a single pass over the frame.
+			DARK, FLAT and IRR must come before any RESAMPLE, BIN or REDUCE stage.
+
+		PIPE:CLEAR
+			Removes all stages from the pipeline (frames are sent as raw counts)
+
+		PIPE:DEFAULT
+			Restores the default pipeline (NONLIN)
+
+		PIPE:STAGES?
+			Returns the stages of the pipeline, separated by semicolons
+
+		PIPE:FALLBACK?
+			Returns 1 if the default pipeline is running in place of the configured one because the configuration
+			can't run right now (calibration still loading, or e.g. IRR with a zero exposure), 0 if not. The
+			configuration is kept and used again as soon as it can run.
+
+		PIPE:POINTS?
+			Returns the number of points in each processed frame
+
+		PIPE:WAVELENGTHS?
+			Returns a list of wavelengths for each point in a processed frame
+
+		CHANNELS?
+			Returns the names of the data plane channels, C1 first. C1 is the output of the configurable pipeline;
+			the rest are fixed points along the calibration chain:
+				RAW			Raw counts
+				DARK		Nonlinearity corrected, dark subtracted
+				FLAT		As DARK, divided by flatness calibration
+				IRR			As FLAT, converted to absolute irradiance
+				SMOOTH		As FLAT, boxcar averaged over 5 points
+			Only C1 is enabled at startup. A channel whose calibration isn't available is not sent.
+
+		Cn:ON
+		Cn:OFF
+			Enables or disables channel n. Only enabled channels are computed. Each is sent as its own block, in
+			channel order; with frame headers on, the header of each block says which channel it is.
+
+		Cn:ENABLED?
+			Returns 1 if channel n is enabled, 0 if not
+
+		Cn:POINTS?
+			Returns the number of points in each frame of channel n
+
+		Cn:FORMAT FLOAT32|INT16|INT8
+			Sets how channel n is sent. FLOAT32 (the default) sends processed samples as is. INT16 and INT8 spread
+			the full range of the integer type evenly over the channel's window and saturate anything outside it,
+			halving or quartering bandwidth. The scale and offset to decode them are in the frame header, so
+			integer formats are only useful with FRAMEHEADER 1.
+
+		Cn:RANGE width
+		Cn:OFFS offset
+			Set the window quantized samples of channel n cover: width wide, centered on -offset. The default
+			(65535, -32767.5) covers 0 to 65535, i.e. raw counts. Applies from the next frame acquired.
+
+		Cn:FORMAT?
+		Cn:RANGE?
+		Cn:OFFS?
+			Return the encoding settings of channel n
+
+		DARK:CAPTURE
+			Saves the next acquired frame as the dark reference
+
+		DARK:CLEAR
+			Discards the dark reference
+
+		ACQMODE TRIGGERED|PIPELINED|CONTINUOUS
+			Sets how frames are acquired. PIPELINED triggers the next exposure as soon as the current one ends,
+			overlapping integration with readout and processing. Runs as TRIGGERED if the device can't do it (see
+			ACQMODE:FALLBACK?), without changing the configured mode.
+			CONTINUOUS lets the device free-run bursts of scans into its internal memory and drains them in batches,
+			minimizing USB commands per frame.
+
+		ACQMODE?
+			Returns the configured acquisition mode
+
+		ACQMODE:FALLBACK?
+			Returns 1 if PIPELINED mode is running as TRIGGERED because the device failed to read out a frame while
+			exposing the next, 0 if not. Cleared when the device is re-opened.
+
+		BURST count
+			Sets the number of scans per burst in CONTINUOUS mode, from 1 to 64 (the device's frame memory). Takes
+			effect at the start of the next burst. If the device rejects it anyway, an error is logged and bursts
+			continue at the previous size until BURST is changed.
+
+		BURST?
+			Returns the number of scans per burst in CONTINUOUS mode
+
+		FRAMERATE hz
+			Sets the target frame rate (may be fractional, e.g. 0.1 for one frame every ten seconds). 0, the default,
+			acquires as fast as the device allows. Triggers are scheduled on absolute deadlines so the rate doesn't
+			drift; if it can't be kept up the schedule restarts from the late frame rather than catching up.
+			In CONTINUOUS mode whole bursts are paced, so frames within a burst are still back to back. Single
+			captures are not delayed. Also set by the sample rate of the bridge protocol.
+
+		FRAMERATE?
+			Returns the target frame rate, 0 if free-running
+
+		FRAMERATE:MAX?
+			Returns the fastest frame rate the current exposure, acquisition mode and measured readout time allow
+
+		CHANGE 0|1
+			Disables or enables change detection. While enabled a frame is only sent if it differs from the last
+			frame sent by more than CHANGE:THRESHOLD, or a keyframe is due. Each frame is reduced to the mean of
+			CHANGE:BANDS equal slices of its first enabled channel, taken in the conversion pass (after the fused
+			elementwise stages, before any block stages), and only those are compared. Skipped frames leave gaps in
+			the sequence numbers but aren't flagged FRAME_FLAG_GAP; keyframes are flagged FRAME_FLAG_KEYFRAME, as
+			are the first frame sent and any frame flagged FRAME_FLAG_GAP, which is always sent. Skipped frames
+			don't go into the event capture history either.
+
+		CHANGE?
+			Returns 1 if change detection is enabled, 0 if not
+
+		CHANGE:METRIC NORM|BAND
+			Sets how frames are compared. NORM (the default) is the RMS difference of the band means relative to
+			their RMS in the last frame sent. BAND is the largest relative change of any one band, which catches
+			narrow features NORM averages away.
+
+		CHANGE:THRESHOLD fraction
+			Sets how much a frame must change to be sent (default 0.01, i.e. 1%)
+
+		CHANGE:BANDS count
+			Sets how many bands each frame is reduced to for comparison (default 32)
+
+		CHANGE:KEYFRAME seconds
+			Sets the longest to go without sending a frame, by exposure time (default 10, 0 for never)
+
+		CHANGE:METRIC?
+		CHANGE:THRESHOLD?
+		CHANGE:BANDS?
+		CHANGE:KEYFRAME?
+			Return the change detection settings
+
+		CHANGE:SKIPPED?
+			Returns the number of frames not sent because they hadn't changed enough
+
+		EVENT 0|1
+			Disables or enables event capture. While enabled (and acquisition is running) frames are kept in a
+			rolling history rather than sent, and each software trigger sends the EVENT:PRE frames before it and
+			the EVENT:POST frames from it on, queued together so they go out in one batch. The frame that was
+			exposing when the trigger fired is the first post-trigger frame. With frame headers on, pre-trigger
+			frames are flagged FRAME_FLAG_PRETRIGGER and the trigger frame FRAME_FLAG_TRIGGER. Triggers that
+			arrive while an event is still being collected are ignored, and no frame is sent in two events.
+
+		EVENT?
+			Returns 1 if event capture is enabled, 0 if not
+
+		EVENT:PRE frames
+		EVENT:POST frames
+			Set the number of frames sent before (default 0) and from (default 1) each trigger. Together they can't
+			exceed the send ring depth. The trigger delay of the bridge protocol also sets EVENT:PRE, converting
+			time to frames at the current frame rate (or the fastest rate the exposure allows if none is set).
+
+		EVENT:PRE?
+		EVENT:POST?
+			Return the number of frames sent before and from each trigger
+
+		EVENT:TRIGGER
+			Fires the software trigger. FORCE does too while event capture is enabled.
+
+		FRAMEHEADER 0|1
+			Disables or enables the header (sequence number, exposure and timestamps) sent before each frame on the
+			data plane. See FrameHeader in Frame.h for the layout.
+
+		FRAMEHEADER?
+			Returns 1 if frame headers are enabled, 0 if not
+
+		RECOVERIES?
+			Returns the number of times the spectrometer has been re-opened after a USB error, or re-attached after
+			being unplugged
+
+		ATTACHED?
+			Returns 1 if a spectrometer is connected, 0 if not (e.g. it's been unplugged and --hotplug is waiting for
+			it to come back)
+
+		STARTUP?
+			Returns how long each startup phase took, then when each startup milestone was reached relative to
+			process start, as "phase=ms,...;milestone=ms,...". Phases are enumerate, connect, configure, bind,
+			flash_read and cal_parse; milestones are listening, calibration and first_frame. Entries that haven't
+			happened yet are left out.
+
+		BATCH:LATENCY us
+			Sets how long a frame may be held back so that following frames can be sent in the same system call.
+			Zero (the default) never waits, but frames that are already queued still go out together.
+
+		BATCH:FRAMES count
+			Sets the maximum number of frames sent in one batch
+
+		BATCH:LATENCY?
+		BATCH:FRAMES?
+			Return the current batching settings
+
+		DATA:SNDBUF bytes
+		DATA:LOWAT bytes
+		DATA:PRIORITY prio
+		DATA:DSCP codepoint
+		DATA:BUSYPOLL us
+		DATA:USERTIMEOUT ms
+		DATA:KEEPALIVE s
+			Set SO_SNDBUF, TCP_NOTSENT_LOWAT, SO_PRIORITY, the IP DiffServ code point, SO_BUSY_POLL,
+			TCP_USER_TIMEOUT or the TCP keepalive idle time (default 10, 0 = off) on the data plane socket.
+			Applied immediately if a client is connected, and to every client that connects later. -1 leaves the
+			option at the system default for new connections. The code point is 0-63.
+
+		DATA:SNDBUF?
+		DATA:LOWAT?
+		DATA:PRIORITY?
+		DATA:DSCP?
+		DATA:BUSYPOLL?
+		DATA:USERTIMEOUT?
+		DATA:KEEPALIVE?
+			Return the configured value of a data plane socket option
+
+		DATA:SENDTIMEOUT ms
+			Sets how long a send to the data plane client may block before the client is disconnected.
+			Acquisition carries on meanwhile, dropping the oldest queued frames. 0 waits forever. Default 5000.
+
+		DATA:SENDTIMEOUT?
+			Returns the send timeout
+
+		DATA:CONNECTED?
+			Returns 1 if a data plane client is connected, 0 if not
+
+		DATA:DROPPED?
+			Returns the number of frames dropped because the current data plane client wasn't keeping up
+
+		DATA:QUEUE?
+			Returns the bytes in the data plane send queue as "unacked,unsent", or "-1,-1" if no client is
+			connected or the platform can't report it
  */
 
 #include "specbridge.h"
+#include "Acquisition.h"
 #include "AseqSCPIServer.h"
+#include "Calibration.h"
+#include "ChangeDetector.h"
+#include "CommandTable.h"
+#include "Device.h"
+#include "EventCapture.h"
+#include "NonlinearityCorrection.h"
+#include "ProcessingPipeline.h"
+#include "SendWatchdog.h"
+#include "SocketTuning.h"
+#include "StartupTiming.h"
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 
 #define __USE_MINGW_ANSI_STDIO 1 // Required for MSYS2 mingw64 to support format "%z" ...
@@ -66,6 +337,370 @@ mutex g_mutex;
 
 bool g_triggerOneShot = false;
 
+static int* GetTuningField(SocketTuning& tuning, const string& cmd);
+static string FormatValues(shared_ptr<const Calibration> cal, const float* (Calibration::*table)() const);
+static bool ApplyNonlinearityCorrection(shared_ptr<const NonlinearityCorrection> correction);
+static CommandTable BuildCommandTable();
+static const CommandTable& GetCommandTable();
+
+/**
+	@brief Formats one of the calibration tables as a comma separated list
+
+	Empty if calibration could not be loaded.
+ */
+static string FormatValues(shared_ptr<const Calibration> cal, const float* (Calibration::*table)() const)
+{
+	string ret;
+	if(!cal)
+		return ret;
+	auto values = ((*cal).*table)();
+	if(!values)
+		return ret;
+
+	char tmp[128];
+	for(size_t i=0; i<cal->m_numPixels; i++)
+	{
+		snprintf(tmp, sizeof(tmp), "%.3f,", values[i]);
+		ret += tmp;
+	}
+	return ret;
+}
+
+/**
+	@brief Switches to a new nonlinearity correction
+
+	@return False if the correction couldn't be built
+ */
+static bool ApplyNonlinearityCorrection(shared_ptr<const NonlinearityCorrection> correction)
+{
+	if(!correction)
+		return false;
+	SetNonlinearityCorrection(correction);
+	RebuildPipeline();
+	return true;
+}
+
+/**
+	@brief Maps a DATA: command to the socket option it controls
+
+	@return The option, or nullptr if the command isn't a socket option
+ */
+static int* GetTuningField(SocketTuning& tuning, const string& cmd)
+{
+	if(cmd == "SNDBUF")
+		return &tuning.m_sendBuffer;
+	else if(cmd == "LOWAT")
+		return &tuning.m_notSentLowWater;
+	else if(cmd == "PRIORITY")
+		return &tuning.m_priority;
+	else if(cmd == "DSCP")
+		return &tuning.m_dscp;
+	else if(cmd == "BUSYPOLL")
+		return &tuning.m_busyPoll;
+	else if(cmd == "USERTIMEOUT")
+		return &tuning.m_userTimeout;
+	else if(cmd == "KEEPALIVE")
+		return &tuning.m_keepAlive;
+	else
+		return nullptr;
+}
+
+/**
+	@brief Gets the table of our own commands and queries, building it the first time
+ */
+static const CommandTable& GetCommandTable()
+{
+	static const CommandTable table = BuildCommandTable();
+	return table;
+}
+
+/**
+	@brief Registers the commands and queries we handle ourselves, for anything BridgeSCPIServer doesn't handle
+ */
+static CommandTable BuildCommandTable()
+{
+	CommandTable t;
+
+	//Calibration and pixel layout
+	t.AddQuery("POINTS", []{ return to_string(g_numPixels); });
+	t.AddQuery("WAVELENGTHS", []{ return FormatValues(GetCalibration(), &Calibration::GetWavelengths); });
+	t.AddQuery("FLATCAL", []{ return FormatValues(GetCalibration(), &Calibration::GetSensorResponse); });
+	t.AddQuery("IRRCAL", []{ return FormatValues(GetCalibration(), &Calibration::GetAbsResponse); });
+	t.AddQuery("IRRCOEFF", []
+		{
+			auto cal = GetCalibration();
+			return to_string(cal ? cal->m_absCal : 1);
+		});
+
+	//Acquisition
+	//convert fs to 10us ticks so e-10
+	t.AddCommand("EXPOSURE", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{ return SetExposureTicks(args.m_number * 1e-10); },
+		1e10, UINT32_MAX * 1e10);
+	t.AddCommand("ACQMODE", CMD_ARGS_WORD, [](const CommandArgs& args)
+		{
+			AcquisitionMode mode;
+			if(!ParseAcquisitionMode(args.m_args[0], mode))
+				return false;
+			g_acquisitionMode = mode;
+			return true;
+		});
+	t.AddQuery("ACQMODE", []{ return GetAcquisitionModeName(g_acquisitionMode); });
+	t.AddQuery("ACQMODE:FALLBACK", []{ return string(IsPipelinedFallback() ? "1" : "0"); });
+	t.AddCommand("BURST", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_burstFrames = args.m_number;
+			return true;
+		},
+		1, MAX_BURST_FRAMES);
+	t.AddQuery("BURST", []{ return to_string(g_burstFrames); });
+	t.AddCommand("FRAMERATE", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{ return SetFrameRate(args.m_number); },
+		0, 1e6);
+	t.AddQuery("FRAMERATE", []{ return to_string(GetFrameRate()); });
+	t.AddQuery("FRAMERATE:MAX", []{ return to_string(GetMaxFrameRate()); });
+
+	//Change detection
+	t.AddCommand("CHANGE", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_changeDetection = (args.m_number != 0);
+			return true;
+		},
+		0, 1);
+	t.AddQuery("CHANGE", []{ return string(g_changeDetection ? "1" : "0"); });
+	t.AddCommand("CHANGE:METRIC", CMD_ARGS_WORD, [](const CommandArgs& args)
+		{
+			ChangeMetric metric;
+			if(!ParseChangeMetric(args.m_args[0], metric))
+				return false;
+			g_changeMetric = metric;
+			return true;
+		});
+	t.AddQuery("CHANGE:METRIC", []{ return GetChangeMetricName(g_changeMetric); });
+	t.AddCommand("CHANGE:THRESHOLD", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_changeThreshold = args.m_number;
+			return true;
+		},
+		0, 1e6);
+	t.AddQuery("CHANGE:THRESHOLD", []{ return to_string(g_changeThreshold); });
+	t.AddCommand("CHANGE:BANDS", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_changeBands = args.m_number;
+			return true;
+		},
+		1, 4096);
+	t.AddQuery("CHANGE:BANDS", []{ return to_string(g_changeBands); });
+	t.AddCommand("CHANGE:KEYFRAME", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_keyframeInterval = args.m_number;
+			return true;
+		},
+		0, 1e6);
+	t.AddQuery("CHANGE:KEYFRAME", []{ return to_string(g_keyframeInterval); });
+	t.AddQuery("CHANGE:SKIPPED", []{ return to_string(g_framesUnchanged.load()); });
+
+	//Event capture
+	t.AddCommand("EVENT", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_eventCapture = (args.m_number != 0);
+			return true;
+		},
+		0, 1);
+	t.AddQuery("EVENT", []{ return string(g_eventCapture ? "1" : "0"); });
+	t.AddCommand("EVENT:PRE", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{ return SetEventFrames(args.m_number, GetEventPostFrames()); },
+		0, UINT32_MAX);
+	t.AddCommand("EVENT:POST", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{ return SetEventFrames(GetEventPreFrames(), args.m_number); },
+		1, UINT32_MAX);
+	t.AddQuery("EVENT:PRE", []{ return to_string(GetEventPreFrames()); });
+	t.AddQuery("EVENT:POST", []{ return to_string(GetEventPostFrames()); });
+	t.AddCommand("EVENT:TRIGGER", CMD_ARGS_NONE, [](const CommandArgs&)
+		{
+			FireEvent();
+			return true;
+		});
+	t.AddCommand("FRAMEHEADER", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_frameHeaders = (args.m_number != 0);
+			return true;
+		},
+		0, 1);
+	t.AddQuery("FRAMEHEADER", []{ return string(g_frameHeaders ? "1" : "0"); });
+
+	//Device and startup status
+	t.AddQuery("RECOVERIES", []{ return to_string(g_deviceRecoveries); });
+	t.AddQuery("ATTACHED", []{ return string(g_deviceAttached ? "1" : "0"); });
+	t.AddQuery("STARTUP", []{ return GetStartupReport(); });
+
+	//Data plane batching
+	t.AddCommand("BATCH:LATENCY", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_batchLatency = args.m_number;
+			return true;
+		},
+		0, UINT32_MAX);
+	t.AddQuery("BATCH:LATENCY", []{ return to_string(g_batchLatency); });
+	t.AddCommand("BATCH:FRAMES", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_batchMaxFrames = args.m_number;
+			return true;
+		},
+		1, UINT32_MAX);
+	t.AddQuery("BATCH:FRAMES", []{ return to_string(g_batchMaxFrames); });
+
+	//Data plane connection
+	t.AddQuery("DATA:QUEUE", []
+		{
+			int queued = -1;
+			int unsent = -1;
+			if(!GetSendQueueDepth(queued, unsent))
+			{
+				queued = -1;
+				unsent = -1;
+			}
+			return to_string(queued) + "," + to_string(unsent);
+		});
+	t.AddCommand("DATA:SENDTIMEOUT", CMD_ARGS_NUMBER, [](const CommandArgs& args)
+		{
+			g_sendTimeout = args.m_number;
+			return true;
+		},
+		0, UINT32_MAX);
+	t.AddQuery("DATA:SENDTIMEOUT", []{ return to_string(g_sendTimeout); });
+	t.AddQuery("DATA:CONNECTED", []{ return string(g_dataClientConnected ? "1" : "0"); });
+	t.AddQuery("DATA:DROPPED", []{ return to_string(g_framesDropped); });
+
+	//Socket options, all handled the same way
+	const char* tuningFields[] = {"SNDBUF", "LOWAT", "PRIORITY", "DSCP", "BUSYPOLL", "USERTIMEOUT", "KEEPALIVE"};
+	for(auto name : tuningFields)
+	{
+		string field(name);
+		double maxValue = (field == "DSCP") ? 63 : INT32_MAX;
+		t.AddCommand(string("DATA:") + name, CMD_ARGS_NUMBER, [field](const CommandArgs& args)
+			{
+				auto tuning = GetSocketTuning();
+				*GetTuningField(tuning, field) = args.m_number;
+				SetSocketTuning(tuning);
+				return true;
+			},
+			-1, maxValue);
+		t.AddQuery(string("DATA:") + name, [field]
+			{
+				auto tuning = GetSocketTuning();
+				return to_string(*GetTuningField(tuning, field));
+			});
+	}
+
+	//Nonlinearity correction
+	t.AddCommand("NLCORR:POLY", CMD_ARGS_NUMBERS, [](const CommandArgs& args)
+		{ return ApplyNonlinearityCorrection(NonlinearityCorrection::FromPolynomial(args.m_numbers)); });
+	t.AddCommand("NLCORR:TABLE", CMD_ARGS_NUMBERS, [](const CommandArgs& args)
+		{
+			//(raw, corrected) pairs
+			if(args.m_numbers.size() % 2)
+				return false;
+			vector<double> raw;
+			vector<double> corrected;
+			for(size_t i=0; i+1<args.m_numbers.size(); i+=2)
+			{
+				raw.push_back(args.m_numbers[i]);
+				corrected.push_back(args.m_numbers[i+1]);
+			}
+			return ApplyNonlinearityCorrection(NonlinearityCorrection::FromTable(raw, corrected));
+		});
+	t.AddCommand("NLCORR:IDENTITY", CMD_ARGS_NONE, [](const CommandArgs&)
+		{ return ApplyNonlinearityCorrection(make_shared<NonlinearityCorrection>()); });
+	t.AddQuery("NLCORR", []{ return GetNonlinearityCorrection()->GetDescription(); });
+
+	//Processing pipeline
+	t.AddCommand("PIPE:ADD", CMD_ARGS_ANY, [](const CommandArgs& args)
+		{
+			auto config = GetPipelineConfig();
+			config.push_back(args.m_args);
+			SetPipelineConfig(config);
+			return true;
+		});
+	t.AddCommand("PIPE:CLEAR", CMD_ARGS_NONE, [](const CommandArgs&)
+		{
+			SetPipelineConfig(vector<StageConfig>());
+			return true;
+		});
+	t.AddCommand("PIPE:DEFAULT", CMD_ARGS_NONE, [](const CommandArgs&)
+		{
+			SetPipelineConfig(GetDefaultPipelineConfig());
+			return true;
+		});
+	t.AddQuery("PIPE:STAGES", []{ return GetPipeline()->GetDescription(); });
+	t.AddQuery("PIPE:FALLBACK", []{ return string(IsPipelineFallback() ? "1" : "0"); });
+	t.AddQuery("PIPE:POINTS", []{ return to_string(GetPipeline()->GetOutputLength()); });
+	t.AddQuery("PIPE:WAVELENGTHS", []
+		{
+			//Wait for calibration so we report the real axis, not pixel indexes
+			GetCalibration();
+			auto pipeline = GetPipeline();
+			string wavelengths;
+			char tmp[128];
+			for(auto w : pipeline->GetWavelengths())
+			{
+				snprintf(tmp, sizeof(tmp), "%.3f,", w);
+				wavelengths += tmp;
+			}
+			return wavelengths;
+		});
+
+	//Channels
+	t.AddQuery("CHANNELS", []
+		{
+			string names;
+			for(size_t i=0; i<CHANNEL_COUNT; i++)
+			{
+				if(i)
+					names += ",";
+				names += GetChannelName(i);
+			}
+			return names;
+		});
+	for(size_t i=0; i<CHANNEL_COUNT; i++)
+	{
+		string prefix = "C" + to_string(i+1) + ":";
+		t.AddQuery(prefix + "ENABLED", [i]{ return string( (GetEnabledChannels() & (1 << i)) ? "1" : "0"); });
+		t.AddQuery(prefix + "POINTS", [i]
+			{
+				//Only C1 can change the pixel mapping
+				if(i == CHANNEL_PIPELINE)
+					return to_string(GetPipeline()->GetOutputLength());
+				return to_string(g_numPixels);
+			});
+
+		t.AddCommand(prefix + "FORMAT", CMD_ARGS_WORD, [i](const CommandArgs& args)
+			{
+				SampleFormat format;
+				if(!ParseSampleFormat(args.m_args[0], format))
+					return false;
+				return SetChannelFormat(i, format);
+			});
+		t.AddQuery(prefix + "FORMAT", [i]{ return string(GetSampleFormatName(GetChannelQuantizer(i).GetFormat())); });
+		t.AddQuery(prefix + "RANGE", [i]{ return to_string(GetChannelQuantizer(i).GetRange()); });
+		t.AddQuery(prefix + "OFFS", [i]{ return to_string(GetChannelQuantizer(i).GetWindowOffset()); });
+	}
+
+	//Dark reference
+	t.AddCommand("DARK:CAPTURE", CMD_ARGS_NONE, [](const CommandArgs&)
+		{
+			g_darkCaptureRequested = true;
+			return true;
+		});
+	t.AddCommand("DARK:CLEAR", CMD_ARGS_NONE, [](const CommandArgs&)
+		{
+			SetDarkFrame(nullptr);
+			return true;
+		});
+
+	return t;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -87,49 +722,13 @@ bool AseqSCPIServer::OnQuery(
 	const string& subject,
 	const string& cmd)
 {
+	string reply;
 	if(BridgeSCPIServer::OnQuery(line, subject, cmd))
 		return true;
-	else if(cmd == "POINTS")
-		SendReply(to_string(g_numPixels));
-	else if(cmd == "WAVELENGTHS")
-	{
-		string wavelengths;
-		char tmp[128];
-		for(int i=0; i<g_numPixels; i++)
-		{
-			snprintf(tmp, sizeof(tmp), "%.3f,", g_wavelengths[i]);
-			wavelengths += tmp;
-		}
-		SendReply(wavelengths);
-	}
-	else if(cmd == "FLATCAL")
-	{
-		string flatcal;
-		char tmp[128];
-		for(int i=0; i<g_numPixels; i++)
-		{
-			snprintf(tmp, sizeof(tmp), "%.3f,", g_sensorResponse[i]);
-			flatcal += tmp;
-		}
-		SendReply(flatcal);
-	}
-	else if(cmd == "IRRCOEFF")
-		SendReply(to_string(g_absCal));
-	else if(cmd == "IRRCAL")
-	{
-		string irrcal;
-		char tmp[128];
-		for(int i=0; i<g_numPixels; i++)
-		{
-			snprintf(tmp, sizeof(tmp), "%.3f,", g_absResponse[i]);
-			irrcal += tmp;
-		}
-		SendReply(irrcal);
-	}
+	else if(GetCommandTable().Query(subject, cmd, reply))
+		SendReply(reply);
 	else
-	{
 		LogDebug("Unrecognized query received: %s\n", line.c_str());
-	}
 	return false;
 }
 
@@ -140,12 +739,14 @@ string AseqSCPIServer::GetMake()
 
 string AseqSCPIServer::GetModel()
 {
-	return g_model;
+	auto cal = GetCalibration();
+	return cal ? cal->m_model : "";
 }
 
 string AseqSCPIServer::GetSerial()
 {
-	return g_serial;
+	auto cal = GetCalibration();
+	return cal ? cal->m_serial : "";
 }
 
 string AseqSCPIServer::GetFirmwareVersion()
@@ -155,13 +756,28 @@ string AseqSCPIServer::GetFirmwareVersion()
 
 size_t AseqSCPIServer::GetAnalogChannelCount()
 {
-	return 1;
+	return CHANNEL_COUNT;
 }
 
+/**
+	@brief Frame rates (in Hz) that can be kept up with the current exposure, in a 1-2-5 sequence
+
+	Always includes 1 Hz, even if the exposure is too long for it, since clients expect at least one rate.
+ */
 vector<size_t> AseqSCPIServer::GetSampleRates()
 {
 	vector<size_t> rates;
-	rates.push_back(1);
+	double limit = GetMaxFrameRate();
+	for(size_t decade = 1; decade <= limit; decade *= 10)
+	{
+		for(size_t step : { 1, 2, 5 })
+		{
+			if(decade*step <= limit)
+				rates.push_back(decade*step);
+		}
+	}
+	if(rates.empty())
+		rates.push_back(1);
 	return rates;
 }
 
@@ -180,25 +796,26 @@ bool AseqSCPIServer::OnCommand(
 {
 	if(BridgeSCPIServer::OnCommand(line, subject, cmd, args))
 		return true;
-	else if(cmd == "EXPOSURE")
-	{
-		lock_guard<mutex> lock(g_mutex);
-
-		//convert fs to 10us ticks so e-10
-		int err;
-		double exposure = stod(args[0]) * 1e-10;
-		if(0 != (err = setExposure(exposure, 0, &g_hDevice)))
-			LogError("failed to set exposure, code %d\n", err);
-	}
+	else if(GetCommandTable().Command(line, subject, cmd, args))
+		return true;
 	else
 		LogError("Unrecognized command %s\n", line.c_str());
 
 	return true;
 }
 
-bool AseqSCPIServer::GetChannelID(const string& /*subject*/, size_t& id_out)
+bool AseqSCPIServer::GetChannelID(const string& subject, size_t& id_out)
 {
-	id_out = 0;
+	//C1 is channel 0
+	if( (subject.size() < 2) || (subject[0] != 'C') )
+		return false;
+
+	char* end;
+	unsigned long n = strtoul(subject.c_str() + 1, &end, 10);
+	if(*end || (n < 1) || (n > CHANNEL_COUNT))
+		return false;
+
+	id_out = n - 1;
 	return true;
 }
 
@@ -209,34 +826,38 @@ BridgeSCPIServer::ChannelType AseqSCPIServer::GetChannelType(size_t /*channel*/)
 
 void AseqSCPIServer::AcquisitionStart(bool oneShot)
 {
-	g_triggerArmed = true;
-	g_triggerOneShot = oneShot;
+	StartAcquisition(oneShot);
 }
 
 void AseqSCPIServer::AcquisitionForceTrigger()
 {
-	g_triggerArmed = true;
+	ForceTrigger();
 }
 
 void AseqSCPIServer::AcquisitionStop()
 {
-	g_triggerArmed = false;
+	StopAcquisition();
 }
 
-void AseqSCPIServer::SetChannelEnabled(size_t /*chIndex*/, bool /*enabled*/)
+void AseqSCPIServer::SetChannelEnabled(size_t chIndex, bool enabled)
 {
+	EnableChannel(chIndex, enabled);
 }
 
 void AseqSCPIServer::SetAnalogCoupling(size_t /*chIndex*/, const std::string& /*coupling*/)
 {
 }
 
-void AseqSCPIServer::SetAnalogRange(size_t /*chIndex*/, double /*range_V*/)
+void AseqSCPIServer::SetAnalogRange(size_t chIndex, double range_V)
 {
+	if(!SetChannelRange(chIndex, range_V))
+		LogError("Invalid range %f for channel %zu\n", range_V, chIndex+1);
 }
 
-void AseqSCPIServer::SetAnalogOffset(size_t /*chIndex*/, double /*offset_V*/)
+void AseqSCPIServer::SetAnalogOffset(size_t chIndex, double offset_V)
 {
+	if(!SetChannelOffset(chIndex, offset_V))
+		LogError("Invalid offset %f for channel %zu\n", offset_V, chIndex+1);
 }
 
 void AseqSCPIServer::SetDigitalThreshold(size_t /*chIndex*/, double /*threshold_V*/)
@@ -247,16 +868,19 @@ void AseqSCPIServer::SetDigitalHysteresis(size_t /*chIndex*/, double /*hysteresi
 {
 }
 
-void AseqSCPIServer::SetSampleRate(uint64_t /*rate_hz*/)
+void AseqSCPIServer::SetSampleRate(uint64_t rate_hz)
 {
+	SetFrameRate(rate_hz);
 }
 
 void AseqSCPIServer::SetSampleDepth(uint64_t /*depth*/)
 {
 }
 
-void AseqSCPIServer::SetTriggerDelay(uint64_t /*delay_fs*/)
+void AseqSCPIServer::SetTriggerDelay(uint64_t delay_fs)
 {
+	if(!SetEventDelay(delay_fs))
+		LogError("Can't convert trigger delay to frames without a frame rate or exposure\n");
 }
 
 void AseqSCPIServer::SetTriggerSource(size_t /*chIndex*/)
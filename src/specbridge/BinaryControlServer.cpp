@@ -0,0 +1,232 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of the binary control server
+
+	Opcodes go to the same functions the SCPI server uses, so both control planes behave identically. Only one
+	binary client is served at a time. It can be connected at the same time as the SCPI client.
+ */
+
+#include "specbridge.h"
+#include "Acquisition.h"
+#include "BinaryControlServer.h"
+#include "Device.h"
+#include "EventCapture.h"
+#include "ProcessingPipeline.h"
+#include "Shutdown.h"
+#include <math.h>
+
+using namespace std;
+
+static void OnBinaryMessage(BinaryControlMessage& msg);
+static void SwapLittleEndian(BinaryControlMessage& msg);
+
+/**
+	@brief Serves binary control clients, one at a time, until shutdown
+ */
+void BinaryControlThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "BinaryControl");
+#endif
+
+	while(!g_shutdownRequested)
+	{
+		Socket client = g_binarySocket.Accept();
+		if(!client.IsValid())
+			break;
+		if(!client.DisableNagle())
+			LogWarning("Failed to disable Nagle on binary control socket, performance may be poor\n");
+		SetControlSocket(client);
+		LogVerbose("Binary control client connected\n");
+
+		BinaryControlMessage msg;
+		while(client.RecvLooped(reinterpret_cast<unsigned char*>(&msg), sizeof(msg)))
+		{
+			SwapLittleEndian(msg);
+			OnBinaryMessage(msg);
+			SwapLittleEndian(msg);
+			if(!client.SendLooped(reinterpret_cast<unsigned char*>(&msg), sizeof(msg)))
+				break;
+		}
+
+		ClearControlSocket(client);
+		LogVerbose("Binary control client disconnected\n");
+	}
+}
+
+/**
+	@brief Converts a message between the little endian wire format and host order (the same swap goes both ways)
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+static void SwapLittleEndian(BinaryControlMessage& msg)
+{
+	msg.m_opcode = __builtin_bswap16(msg.m_opcode);
+	msg.m_status = __builtin_bswap16(msg.m_status);
+	msg.m_tag = __builtin_bswap32(msg.m_tag);
+	msg.m_value = static_cast<int64_t>(__builtin_bswap64(static_cast<uint64_t>(msg.m_value)));
+}
+#else
+static void SwapLittleEndian(BinaryControlMessage& /*msg*/)
+{
+}
+#endif
+
+/**
+	@brief Handles one request, turning it into the response in place
+ */
+static void OnBinaryMessage(BinaryControlMessage& msg)
+{
+	auto value = msg.m_value;
+	msg.m_status = BINSTATUS_OK;
+	msg.m_value = 0;
+
+	switch(msg.m_opcode)
+	{
+		case BINOP_NOP:
+			break;
+
+		case BINOP_START:
+			StartAcquisition(false);
+			break;
+
+		case BINOP_SINGLE:
+			StartAcquisition(true);
+			break;
+
+		case BINOP_STOP:
+			StopAcquisition();
+			break;
+
+		case BINOP_FORCE:
+			ForceTrigger();
+			break;
+
+		//convert fs to 10us ticks
+		case BINOP_SET_EXPOSURE:
+			if( (value < 10000000000LL) || (value / 10000000000LL > UINT32_MAX) )
+				msg.m_status = BINSTATUS_BAD_ARGUMENT;
+			else if(!SetExposureTicks(value / 10000000000LL))
+				msg.m_status = BINSTATUS_DEVICE_ERROR;
+			break;
+
+		case BINOP_GET_EXPOSURE:
+			msg.m_value = g_exposure * 10000000000LL;
+			break;
+
+		case BINOP_SET_ACQMODE:
+			if( (value < ACQ_TRIGGERED) || (value > ACQ_CONTINUOUS) )
+				msg.m_status = BINSTATUS_BAD_ARGUMENT;
+			else
+				g_acquisitionMode = static_cast<AcquisitionMode>(value);
+			break;
+
+		case BINOP_GET_ACQMODE:
+			msg.m_value = g_acquisitionMode;
+			break;
+
+		case BINOP_SET_BURST:
+			if( (value < 1) || (value > MAX_BURST_FRAMES) )
+				msg.m_status = BINSTATUS_BAD_ARGUMENT;
+			else
+				g_burstFrames = value;
+			break;
+
+		case BINOP_GET_BURST:
+			msg.m_value = g_burstFrames;
+			break;
+
+		case BINOP_SET_FRAMEHEADER:
+			g_frameHeaders = (value != 0);
+			break;
+
+		case BINOP_GET_FRAMEHEADER:
+			msg.m_value = g_frameHeaders;
+			break;
+
+		case BINOP_SET_CHANNELS:
+			if( (value < 0) || (value >= (1 << CHANNEL_COUNT)) )
+				msg.m_status = BINSTATUS_BAD_ARGUMENT;
+			else
+			{
+				for(size_t i=0; i<CHANNEL_COUNT; i++)
+					EnableChannel(i, (value >> i) & 1);
+			}
+			break;
+
+		case BINOP_GET_CHANNELS:
+			msg.m_value = GetEnabledChannels();
+			break;
+
+		case BINOP_SET_FRAMERATE:
+			if(!SetFrameRate(value * 1e-3))
+				msg.m_status = BINSTATUS_BAD_ARGUMENT;
+			break;
+
+		case BINOP_GET_FRAMERATE:
+			msg.m_value = llround(GetFrameRate() * 1e3);
+			break;
+
+		case BINOP_DARK_CAPTURE:
+			g_darkCaptureRequested = true;
+			break;
+
+		case BINOP_DARK_CLEAR:
+			SetDarkFrame(nullptr);
+			break;
+
+		case BINOP_EVENT_TRIGGER:
+			FireEvent();
+			break;
+
+		case BINOP_GET_DROPPED:
+			msg.m_value = g_framesDropped;
+			break;
+
+		case BINOP_GET_RECOVERIES:
+			msg.m_value = g_deviceRecoveries;
+			break;
+
+		case BINOP_GET_ATTACHED:
+			msg.m_value = g_deviceAttached;
+			break;
+
+		case BINOP_GET_CONNECTED:
+			msg.m_value = g_dataClientConnected;
+			break;
+
+		default:
+			LogDebug("Unrecognized binary opcode 0x%04x\n", msg.m_opcode);
+			msg.m_status = BINSTATUS_UNKNOWN_OPCODE;
+			break;
+	}
+}
@@ -0,0 +1,126 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Compact binary control protocol, for automation that changes settings every frame
+
+	Enabled with --binary-port. Every request is one fixed size BinaryControlMessage, and gets exactly one
+	BinaryControlMessage back with the same opcode and tag, so requests can be pipelined and matched up by tag.
+ */
+
+#ifndef BinaryControlServer_h
+#define BinaryControlServer_h
+
+#include <stdint.h>
+
+#pragma pack(push, 1)
+
+/**
+	@brief A binary control request or response. All fields are little endian.
+ */
+class BinaryControlMessage
+{
+public:
+	///@brief A BinaryOpcode
+	uint16_t m_opcode;
+
+	///@brief A BinaryStatus in responses, zero in requests
+	uint16_t m_status;
+
+	///@brief Chosen by the client, echoed back in the response
+	uint32_t m_tag;
+
+	///@brief Argument for set operations, result for get operations
+	int64_t m_value;
+};
+
+#pragma pack(pop)
+
+enum BinaryOpcode
+{
+	///@brief Does nothing, for measuring round trip time
+	BINOP_NOP				= 0x0000,
+
+	///@brief Same as START, SINGLE, STOP and FORCE
+	BINOP_START				= 0x0001,
+	BINOP_SINGLE			= 0x0002,
+	BINOP_STOP				= 0x0003,
+	BINOP_FORCE				= 0x0004,
+
+	///@brief Exposure time, in fs
+	BINOP_SET_EXPOSURE		= 0x0010,
+	BINOP_GET_EXPOSURE		= 0x0011,
+
+	///@brief Acquisition mode, as an AcquisitionMode
+	BINOP_SET_ACQMODE		= 0x0012,
+	BINOP_GET_ACQMODE		= 0x0013,
+
+	///@brief Scans per burst in continuous mode
+	BINOP_SET_BURST			= 0x0014,
+	BINOP_GET_BURST			= 0x0015,
+
+	///@brief Frame headers on the data plane, 0 or 1
+	BINOP_SET_FRAMEHEADER	= 0x0016,
+	BINOP_GET_FRAMEHEADER	= 0x0017,
+
+	///@brief Enabled data plane channels, as a bitmask (bit 0 is C1)
+	BINOP_SET_CHANNELS		= 0x0018,
+	BINOP_GET_CHANNELS		= 0x0019,
+
+	///@brief Target frame rate, in mHz (0 = free-running)
+	BINOP_SET_FRAMERATE		= 0x001a,
+	BINOP_GET_FRAMERATE		= 0x001b,
+
+	///@brief Same as DARK:CAPTURE and DARK:CLEAR
+	BINOP_DARK_CAPTURE		= 0x0020,
+	BINOP_DARK_CLEAR		= 0x0021,
+
+	///@brief Same as EVENT:TRIGGER
+	BINOP_EVENT_TRIGGER		= 0x0022,
+
+	///@brief Same as DATA:DROPPED?, RECOVERIES?, ATTACHED? and DATA:CONNECTED?
+	BINOP_GET_DROPPED		= 0x0030,
+	BINOP_GET_RECOVERIES	= 0x0031,
+	BINOP_GET_ATTACHED		= 0x0032,
+	BINOP_GET_CONNECTED		= 0x0033
+};
+
+enum BinaryStatus
+{
+	BINSTATUS_OK				= 0,
+	BINSTATUS_UNKNOWN_OPCODE	= 1,
+	BINSTATUS_BAD_ARGUMENT		= 2,
+	BINSTATUS_DEVICE_ERROR		= 3
+};
+
+void BinaryControlThread();
+
+#endif
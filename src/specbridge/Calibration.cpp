@@ -0,0 +1,261 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of Calibration
+
+	Reading and parsing the whole calibration flash takes long enough that we don't want clients waiting on it. It
+	is loaded on a background thread instead, while raw (nonlinearity-corrected) frames are already streaming. The
+	flash is read in small chunks, each under g_mutex, so acquisition can slot in between them.
+
+	Each chunk is parsed as soon as it arrives, and reading stops once every table the header says is present has
+	been parsed. The text ends at the first NUL, so the size of the calibration block doesn't need to be known.
+ */
+
+#include "specbridge.h"
+#include "Calibration.h"
+#include "ProcessingPipeline.h"
+#include "Shutdown.h"
+#include "StartupTiming.h"
+#include <algorithm>
+#include <condition_variable>
+#include <string.h>
+
+using namespace std;
+
+//Give up if the calibration text hasn't ended by this point
+#define CAL_MAX_SIZE		(256 * 1024)
+
+//Bytes read per USB transaction
+#define CAL_CHUNK_SIZE		4096
+
+//How long to keep retrying a failed chunk (e.g. while the device is being recovered)
+#define CAL_RETRY_COUNT		100
+#define CAL_RETRY_DELAY_MS	100
+
+static mutex g_calibrationMutex;
+static condition_variable g_calibrationReady;
+static shared_ptr<const Calibration> g_calibration;
+static bool g_calibrationLoading = false;
+
+//Started and joined by whichever thread opens the device (main, hotplug monitor or data thread recovery),
+//so every access is under g_calibrationThreadMutex
+static mutex g_calibrationThreadMutex;
+static thread g_calibrationThread;
+
+static void CalibrationLoadThread();
+static shared_ptr<Calibration> ReadCalibration();
+static bool ReadCalibrationChunk(char* buf, size_t offset, size_t len);
+
+/**
+	@brief Starts (re)loading calibration from the device in the background
+
+	Any previously loaded calibration stays available until the new one is ready.
+ */
+void StartCalibrationLoad()
+{
+	lock_guard<mutex> threadLock(g_calibrationThreadMutex);
+	if(g_calibrationThread.joinable())
+		g_calibrationThread.join();
+
+	{
+		lock_guard<mutex> lock(g_calibrationMutex);
+		g_calibrationLoading = true;
+	}
+	g_calibrationThread = thread(CalibrationLoadThread);
+}
+
+/**
+	@brief Waits for a background load, if any, to finish
+ */
+void JoinCalibrationLoad()
+{
+	lock_guard<mutex> threadLock(g_calibrationThreadMutex);
+	if(g_calibrationThread.joinable())
+		g_calibrationThread.join();
+}
+
+/**
+	@brief Gets the calibration, waiting for it to finish loading if necessary
+
+	@return The calibration, or null if it could not be loaded
+ */
+shared_ptr<const Calibration> GetCalibration()
+{
+	unique_lock<mutex> lock(g_calibrationMutex);
+	g_calibrationReady.wait(lock, []{ return !g_calibrationLoading; });
+	return g_calibration;
+}
+
+/**
+	@brief Gets the calibration without waiting
+
+	@return The calibration, or null if it hasn't been loaded yet
+ */
+shared_ptr<const Calibration> TryGetCalibration()
+{
+	lock_guard<mutex> lock(g_calibrationMutex);
+	return g_calibration;
+}
+
+static void CalibrationLoadThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "CalLoader");
+#endif
+
+	LogDebug("Reading calibration data...\n");
+	auto start = chrono::steady_clock::now();
+
+	auto cal = ReadCalibration();
+	if(cal)
+	{
+		auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+		LogVerbose("Loaded calibration for %s %s in %d ms\n", cal->m_model.c_str(), cal->m_serial.c_str(), (int)ms);
+
+		{
+			lock_guard<mutex> lock(g_calibrationMutex);
+			g_calibration = cal;
+		}
+
+		//Pick up stages that were waiting on calibration, and the real wavelength axis
+		RebuildPipeline();
+		RecordStartupMilestone("calibration");
+	}
+
+	//Wake up anyone waiting, even if we failed, so they don't hang forever
+	{
+		lock_guard<mutex> lock(g_calibrationMutex);
+		g_calibrationLoading = false;
+	}
+	g_calibrationReady.notify_all();
+}
+
+/**
+	@brief Reads and parses the calibration text from flash, a chunk at a time
+
+	@return The calibration, or null if it could not be read or is malformed
+ */
+static shared_ptr<Calibration> ReadCalibration()
+{
+	CalibrationParser parser(g_numPixels);
+	vector<char> chunk(CAL_CHUNK_SIZE);
+
+	//A line split across two chunks
+	string partial;
+
+	auto parseTime = chrono::steady_clock::duration::zero();
+	auto start = chrono::steady_clock::now();
+
+	size_t offset = 0;
+	bool textEnded = false;
+	while(!textEnded && !parser.IsComplete())
+	{
+		if(offset >= CAL_MAX_SIZE)
+		{
+			LogError("calibration data has no end\n");
+			return nullptr;
+		}
+		if(!ReadCalibrationChunk(&chunk[0], offset, CAL_CHUNK_SIZE))
+			return nullptr;
+		offset += CAL_CHUNK_SIZE;
+
+		auto parseStart = chrono::steady_clock::now();
+
+		//Text ends at the first NUL, if there is one
+		const char* p = &chunk[0];
+		const char* end = p + CAL_CHUNK_SIZE;
+		auto nul = static_cast<const char*>(memchr(p, '\0', CAL_CHUNK_SIZE));
+		if(nul)
+		{
+			end = nul;
+			textEnded = true;
+		}
+
+		while( (p < end) && !parser.IsComplete() )
+		{
+			auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+			if(!eol)
+			{
+				partial.append(p, end);
+				break;
+			}
+
+			bool ok;
+			if(partial.empty())
+				ok = parser.OnLine(p, eol - p);
+			else
+			{
+				partial.append(p, eol);
+				ok = parser.OnLine(partial.c_str(), partial.length());
+				partial.clear();
+			}
+			if(!ok)
+				return nullptr;
+			p = eol + 1;
+		}
+
+		parseTime += chrono::steady_clock::now() - parseStart;
+	}
+
+	//Last line might not have a newline
+	if(!partial.empty() && !parser.OnLine(partial.c_str(), partial.length()))
+		return nullptr;
+
+	LogDebug("Read %zu bytes of calibration flash\n", offset);
+	RecordStartupPhase("flash_read", chrono::steady_clock::now() - start - parseTime);
+	RecordStartupPhase("cal_parse", parseTime);
+	return parser.Finish();
+}
+
+/**
+	@brief Reads one chunk of calibration flash, retrying for a while if it fails
+ */
+static bool ReadCalibrationChunk(char* buf, size_t offset, size_t len)
+{
+	int err = 0;
+	for(int attempt = 0; attempt < CAL_RETRY_COUNT; attempt ++)
+	{
+		if(g_shutdownRequested)
+			return false;
+
+		{
+			lock_guard<mutex> lock(g_mutex);
+			err = readFlash(reinterpret_cast<uint8_t*>(buf), offset, len, &g_hDevice);
+		}
+		if(err == 0)
+			return true;
+		this_thread::sleep_for(chrono::milliseconds(CAL_RETRY_DELAY_MS));
+	}
+
+	LogError("failed to read cal data, code %d\n", err);
+	return false;
+}
@@ -0,0 +1,110 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of Calibration
+ */
+
+#ifndef Calibration_h
+#define Calibration_h
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+	@brief Factory calibration data read from the spectrometer's flash
+
+	Never modified once loaded, so it can be shared between threads without locking.
+ */
+class Calibration
+{
+public:
+	Calibration()
+	: m_hasAbsCal(false)
+	, m_numPixels(0)
+	, m_absCal(1)
+	{}
+
+	static bool ParseHeader(const char* line, size_t len, std::string& model, bool& hasAbsCal, std::string& serial);
+
+	///@brief Wavelengths, in nm, of each spectral bin
+	const float* GetWavelengths() const
+	{ return &m_tables[0]; }
+
+	///@brief Sensor flatness calibration
+	const float* GetSensorResponse() const
+	{ return &m_tables[m_numPixels]; }
+
+	///@brief Absolute irradiance calibration (null if not present)
+	const float* GetAbsResponse() const
+	{ return (m_tables.size() >= 3*m_numPixels) ? &m_tables[2*m_numPixels] : nullptr; }
+
+	std::string m_model;
+	std::string m_serial;
+	bool m_hasAbsCal;
+
+	///@brief Number of spectral bins in each table
+	size_t m_numPixels;
+
+	///@brief All of the per-pixel tables back to back, in one allocation
+	std::vector<float> m_tables;
+	float m_absCal;
+};
+
+/**
+	@brief Builds a Calibration from the flash text one line at a time, without keeping the text around
+ */
+class CalibrationParser
+{
+public:
+	CalibrationParser(size_t numPixels);
+
+	bool OnLine(const char* line, size_t len);
+	bool IsComplete() const;
+	std::shared_ptr<Calibration> Finish();
+
+protected:
+	std::shared_ptr<Calibration> m_cal;
+
+	///@brief Zero based index of the next line
+	size_t m_line;
+
+	///@brief Set if a line was malformed
+	bool m_failed;
+};
+
+void StartCalibrationLoad();
+void JoinCalibrationLoad();
+std::shared_ptr<const Calibration> GetCalibration();
+std::shared_ptr<const Calibration> TryGetCalibration();
+
+#endif
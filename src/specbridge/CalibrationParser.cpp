@@ -0,0 +1,172 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CalibrationParser
+
+	Kept apart from the loading code in Calibration.cpp, which needs the device, so it can be unit tested on its own.
+ */
+
+#include "specbridge.h"
+#include "Calibration.h"
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+/**
+	@brief Parses the first line of the calibration text: "model c.[Y|N] serial"
+
+	@return False if the line is malformed
+ */
+bool Calibration::ParseHeader(const char* line, size_t len, string& model, bool& hasAbsCal, string& serial)
+{
+	char buf[128];
+	len = min(len, sizeof(buf) - 1);
+	memcpy(buf, line, len);
+	buf[len] = '\0';
+
+	char fields[3][64];
+	if(3 != sscanf(buf, "%63s %63s %63s", fields[0], fields[1], fields[2]))
+		return false;
+
+	model = fields[0];
+	hasAbsCal = !strcmp(fields[1], "c.Y");
+	serial = fields[2];
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CalibrationParser
+
+CalibrationParser::CalibrationParser(size_t numPixels)
+	: m_cal(make_shared<Calibration>())
+	, m_line(0)
+	, m_failed(false)
+{
+	m_cal->m_numPixels = numPixels;
+}
+
+/**
+	@brief Handles one line of the calibration text (without the newline)
+
+	@return False if the line was malformed
+ */
+bool CalibrationParser::OnLine(const char* line, size_t len)
+{
+	//Empty lines don't count towards the line numbers
+	if(len == 0)
+		return true;
+	size_t n = m_line ++;
+	size_t npix = m_cal->m_numPixels;
+
+	//Values are short, so parse from a NUL terminated copy rather than trusting what comes after the line
+	char buf[64];
+	size_t copylen = min(len, sizeof(buf) - 1);
+	memcpy(buf, line, copylen);
+	buf[copylen] = '\0';
+
+	//First line: model c.[Y|N] serial
+	if(n == 0)
+	{
+		if(!Calibration::ParseHeader(line, len, m_cal->m_model, m_cal->m_hasAbsCal, m_cal->m_serial))
+		{
+			LogError("malformed cal data header\n");
+			m_failed = true;
+			return false;
+		}
+		LogDebug("Spectrometer is model %s, serial %s\n", m_cal->m_model.c_str(), m_cal->m_serial.c_str());
+		if(m_cal->m_hasAbsCal)
+			LogDebug("Absolute cal data present\n");
+
+		//Room for all of the tables up front, so they end up in one block
+		m_cal->m_tables.reserve( (m_cal->m_hasAbsCal ? 3 : 2) * npix);
+	}
+
+	//Second line: absolute irradiance scale
+	else if(n == 1)
+		m_cal->m_absCal = atof(buf);
+
+	//Starting at line 13 (one based, per docs) of the file we have one line of wavelength data per spectral bin,
+	//then a blank line, then the sensor response normalization data, then absolute irradiance data if present
+	else if( (n >= 12) && (n < 12 + npix) )
+		m_cal->m_tables.push_back(atof(buf));
+	else if( (n >= 13 + npix) && (n < 13 + 3*npix) )
+		m_cal->m_tables.push_back(atof(buf));
+
+	return true;
+}
+
+/**
+	@brief Checks if every table the header says is present has been parsed, so there's no need to read any further
+ */
+bool CalibrationParser::IsComplete() const
+{
+	if(m_line == 0)
+		return false;
+	size_t tables = m_cal->m_hasAbsCal ? 3 : 2;
+	return m_cal->m_tables.size() >= tables * m_cal->m_numPixels;
+}
+
+/**
+	@brief Gets the parsed calibration, once the text has been handed to OnLine()
+
+	@return The calibration, or null if the text was malformed or truncated
+ */
+shared_ptr<Calibration> CalibrationParser::Finish()
+{
+	LogDebug("Found %zu lines of data\n", m_line);
+	if(m_failed)
+		return nullptr;
+
+	size_t npix = m_cal->m_numPixels;
+	auto& tables = m_cal->m_tables;
+	if(tables.size() < 2*npix)
+	{
+		LogError("calibration data is truncated (%zu lines)\n", m_line);
+		return nullptr;
+	}
+
+	//Drop a partial irradiance table
+	if(tables.size() < 3*npix)
+	{
+		tables.resize(2*npix);
+		tables.shrink_to_fit();
+	}
+
+	LogDebug("First pixel is %.3f nm\n", m_cal->GetWavelengths()[0]);
+	LogDebug("Last pixel is %.3f nm\n", m_cal->GetWavelengths()[npix-1]);
+	LogDebug("First pixel norm coeff is %.3f\n", m_cal->GetSensorResponse()[0]);
+	LogDebug("Mid pixel norm coeff is %.3f\n", m_cal->GetSensorResponse()[npix*2/3]);
+	LogDebug("Last pixel norm coeff is %.3f\n", m_cal->GetSensorResponse()[npix-1]);
+
+	return m_cal;
+}
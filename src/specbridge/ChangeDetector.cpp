@@ -0,0 +1,152 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ChangeDetector
+ */
+
+#include "specbridge.h"
+#include "ChangeDetector.h"
+#include <math.h>
+
+using namespace std;
+
+//Only send frames that differ from the last one sent
+volatile bool g_changeDetection = false;
+volatile ChangeMetric g_changeMetric = CHANGE_NORM;
+
+//Relative change needed to send a frame
+volatile float g_changeThreshold = 0.01;
+
+//Number of bands each frame is reduced to for comparison
+volatile unsigned int g_changeBands = 32;
+
+//Longest to go without sending a frame, in seconds (0 for no keyframes)
+volatile float g_keyframeInterval = 10;
+
+//Frames not sent because they hadn't changed enough, for SCPI queries
+atomic<uint64_t> g_framesUnchanged(0);
+
+bool ParseChangeMetric(const string& name, ChangeMetric& metric)
+{
+	if(name == "NORM")
+		metric = CHANGE_NORM;
+	else if(name == "BAND")
+		metric = CHANGE_BAND;
+	else
+		return false;
+	return true;
+}
+
+string GetChangeMetricName(ChangeMetric metric)
+{
+	if(metric == CHANGE_BAND)
+		return "BAND";
+	return "NORM";
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ChangeDetector
+
+ChangeDetector::ChangeDetector()
+	: m_lastSent(0)
+{
+}
+
+/**
+	@brief Takes the next processed frame, in sequence order
+
+	@return True if the frame should be sent. Keyframes, including every frame flagged FRAME_FLAG_GAP, are flagged
+	FRAME_FLAG_KEYFRAME.
+ */
+bool ChangeDetector::Offer(Frame& frame)
+{
+	if(!g_changeDetection || frame.m_bands.empty())
+	{
+		m_reference.clear();
+		return true;
+	}
+
+	//First frame, or the band layout changed: nothing to compare against.
+	//Frames after a gap always go out too, or a client would never find out it lost data.
+	bool keyframe = (m_reference.size() != frame.m_bands.size()) || (frame.m_flags & FRAME_FLAG_GAP);
+
+	float interval = g_keyframeInterval;
+	if( (interval > 0) && (frame.m_midExposure - m_lastSent >= interval * 1e9) )
+		keyframe = true;
+
+	if(!keyframe && (GetChange(frame.m_bands) < g_changeThreshold) )
+	{
+		g_framesUnchanged ++;
+		return false;
+	}
+
+	if(keyframe)
+		frame.m_flags |= FRAME_FLAG_KEYFRAME;
+	m_reference = frame.m_bands;
+	m_lastSent = frame.m_midExposure;
+	return true;
+}
+
+/**
+	@brief Measures how far a frame's band means are from the last frame sent, as a fraction
+ */
+float ChangeDetector::GetChange(const vector<float>& bands) const
+{
+	if(g_changeMetric == CHANGE_BAND)
+	{
+		//Relative to the reference, but with a floor so near-zero (e.g. dark subtracted) bands don't blow up.
+		//The floor is a small fraction of the largest band, so it scales with whatever units the channel is in.
+		float peak = 0;
+		for(auto r : m_reference)
+			peak = max(peak, fabsf(r));
+		float floor = max(peak * 1e-3f, 1e-6f);
+
+		float worst = 0;
+		for(size_t i=0; i<bands.size(); i++)
+			worst = max(worst, fabsf(bands[i] - m_reference[i]) / max(fabsf(m_reference[i]), floor));
+		return worst;
+	}
+
+	double diff = 0;
+	double ref = 0;
+	for(size_t i=0; i<bands.size(); i++)
+	{
+		double d = bands[i] - m_reference[i];
+		diff += d*d;
+		ref += m_reference[i] * m_reference[i];
+	}
+
+	//A reference of all zeros: any change at all counts
+	if(ref == 0)
+		return (diff > 0) ? INFINITY : 0;
+	return sqrt(diff / ref);
+}
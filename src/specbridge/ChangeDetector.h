@@ -0,0 +1,92 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ChangeDetector
+ */
+
+#ifndef ChangeDetector_h
+#define ChangeDetector_h
+
+#include "Frame.h"
+#include <atomic>
+#include <string>
+
+/**
+	@brief How a frame is compared to the last one sent
+ */
+enum ChangeMetric
+{
+	///@brief RMS difference of the band means, relative to the RMS of the reference band means
+	CHANGE_NORM,
+
+	///@brief Largest relative change of any single band (catches narrow features the norm averages away)
+	CHANGE_BAND
+};
+
+extern volatile bool g_changeDetection;
+extern volatile ChangeMetric g_changeMetric;
+extern volatile float g_changeThreshold;
+extern volatile unsigned int g_changeBands;
+extern volatile float g_keyframeInterval;
+extern std::atomic<uint64_t> g_framesUnchanged;
+
+bool ParseChangeMetric(const std::string& name, ChangeMetric& metric);
+std::string GetChangeMetricName(ChangeMetric metric);
+
+/**
+	@brief Decides which frames are worth sending when change detection is enabled
+
+	Each frame carries the mean of a few bands of its first channel, taken in the conversion pass. Those are compared
+	to the band means of the last frame sent, and the frame is only sent if the difference is over the threshold or a
+	keyframe is due. Frames flagged FRAME_FLAG_GAP are always sent, as keyframes. Comparing to the last frame sent
+	rather than the previous frame means slow drift is still picked up once it adds up.
+
+	One instance is owned by each data thread, which offers it frames in sequence order.
+ */
+class ChangeDetector
+{
+public:
+	ChangeDetector();
+
+	bool Offer(Frame& frame);
+
+protected:
+	float GetChange(const std::vector<float>& bands) const;
+
+	///@brief Band means of the last frame sent (empty if none yet)
+	std::vector<float> m_reference;
+
+	///@brief Mid-exposure time of the last frame sent
+	int64_t m_lastSent;
+};
+
+#endif
@@ -0,0 +1,204 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CommandTable
+ */
+
+#include "specbridge.h"
+#include "CommandTable.h"
+
+using namespace std;
+
+static bool ParseNumber(const string& str, double& value);
+
+/**
+	@brief Converts one SCPI argument to a number
+
+	@return False if it isn't entirely a valid number
+ */
+static bool ParseNumber(const string& str, double& value)
+{
+	char* end = nullptr;
+	value = strtod(str.c_str(), &end);
+	return (end != str.c_str()) && (*end == '\0');
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registration
+
+/**
+	@brief Registers a command
+
+	@param name		"SUBJECT:CMD", or "CMD" to accept any subject
+	@param type		What the arguments must look like
+	@param handler	Called with the parsed arguments
+	@param minValue	Smallest acceptable value for CMD_ARGS_NUMBER
+	@param maxValue	Largest acceptable value for CMD_ARGS_NUMBER
+ */
+void CommandTable::AddCommand(
+	const string& name,
+	CommandArgType type,
+	CommandHandler handler,
+	double minValue,
+	double maxValue)
+{
+	CommandEntry entry;
+	entry.m_type = type;
+	entry.m_min = minValue;
+	entry.m_max = maxValue;
+	entry.m_handler = handler;
+	Insert(m_commands, name, entry);
+}
+
+/**
+	@brief Registers a query, named as for AddCommand() but without the question mark
+ */
+void CommandTable::AddQuery(const string& name, QueryHandler handler)
+{
+	Insert(m_queries, name, handler);
+}
+
+/**
+	@brief Files an entry under its subject, splitting "SUBJECT:CMD" at the colon
+ */
+template<class T>
+void CommandTable::Insert(SubjectTable<T>& table, const string& name, const T& entry)
+{
+	auto colon = name.find(':');
+	if(colon == string::npos)
+		table[""][name] = entry;
+	else
+		table[name.substr(0, colon)][name.substr(colon + 1)] = entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+template<class T>
+const T* CommandTable::Find(const SubjectTable<T>& table, const string& subject, const string& cmd)
+{
+	//Exact subject match first, then entries that accept any subject
+	auto sit = table.find(subject);
+	if(sit != table.end())
+	{
+		auto it = sit->second.find(cmd);
+		if(it != sit->second.end())
+			return &it->second;
+	}
+
+	if(!subject.empty())
+	{
+		sit = table.find("");
+		if(sit != table.end())
+		{
+			auto it = sit->second.find(cmd);
+			if(it != sit->second.end())
+				return &it->second;
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+	@brief Validates and runs a command
+
+	Malformed arguments and handler failures are logged here, so handlers don't need to.
+
+	@return False if there is no such command
+ */
+bool CommandTable::Command(
+	const string& line,
+	const string& subject,
+	const string& cmd,
+	const vector<string>& args) const
+{
+	auto entry = Find(m_commands, subject, cmd);
+	if(!entry)
+		return false;
+
+	CommandArgs parsed(args);
+	if(!ParseArgs(*entry, parsed))
+		LogError("Invalid argument in %s\n", line.c_str());
+	else if(!entry->m_handler(parsed))
+		LogError("Failed to apply %s\n", line.c_str());
+	return true;
+}
+
+/**
+	@brief Runs a query
+
+	@return False if there is no such query
+ */
+bool CommandTable::Query(const string& subject, const string& cmd, string& reply) const
+{
+	auto handler = Find(m_queries, subject, cmd);
+	if(!handler)
+		return false;
+
+	reply = (*handler)();
+	return true;
+}
+
+/**
+	@brief Checks arguments against what the command expects, converting them as needed
+ */
+bool CommandTable::ParseArgs(const CommandEntry& entry, CommandArgs& args)
+{
+	switch(entry.m_type)
+	{
+		case CMD_ARGS_NONE:
+			return args.m_args.empty();
+
+		case CMD_ARGS_NUMBER:
+			return (args.m_args.size() == 1) &&
+				ParseNumber(args.m_args[0], args.m_number) &&
+				(args.m_number >= entry.m_min) &&
+				(args.m_number <= entry.m_max);
+
+		case CMD_ARGS_WORD:
+			return (args.m_args.size() == 1);
+
+		case CMD_ARGS_NUMBERS:
+			args.m_numbers.resize(args.m_args.size());
+			for(size_t i=0; i<args.m_args.size(); i++)
+			{
+				if(!ParseNumber(args.m_args[i], args.m_numbers[i]))
+					return false;
+			}
+			return true;
+
+		case CMD_ARGS_ANY:
+		default:
+			return true;
+	}
+}
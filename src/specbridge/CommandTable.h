@@ -0,0 +1,143 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of CommandTable
+ */
+
+#ifndef CommandTable_h
+#define CommandTable_h
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+	@brief What a command expects for arguments. Anything else is rejected before the handler runs.
+ */
+enum CommandArgType
+{
+	///@brief No arguments
+	CMD_ARGS_NONE,
+
+	///@brief Exactly one number, within the command's range
+	CMD_ARGS_NUMBER,
+
+	///@brief Exactly one word
+	CMD_ARGS_WORD,
+
+	///@brief Any number of numbers (including none)
+	CMD_ARGS_NUMBERS,
+
+	///@brief Passed through as is
+	CMD_ARGS_ANY
+};
+
+/**
+	@brief Arguments to a command, already parsed according to its CommandArgType
+ */
+class CommandArgs
+{
+public:
+	CommandArgs(const std::vector<std::string>& args)
+	: m_args(args)
+	, m_number(0)
+	{}
+
+	///@brief The arguments as received
+	const std::vector<std::string>& m_args;
+
+	///@brief The argument, for CMD_ARGS_NUMBER
+	double m_number;
+
+	///@brief The arguments, for CMD_ARGS_NUMBERS
+	std::vector<double> m_numbers;
+};
+
+/**
+	@brief Hashed lookup of SCPI commands and queries to their handlers
+
+	Entries are registered as "SUBJECT:CMD", or just "CMD" to match regardless of subject. An exact subject match
+	wins, so e.g. PIPE:POINTS? and POINTS? can have different handlers. Entries are keyed by subject, then command,
+	so lookup cost doesn't depend on the number of commands and nothing is allocated per dispatch.
+ */
+class CommandTable
+{
+public:
+	///@brief Runs a command. Returns false if the arguments were valid but couldn't be applied.
+	typedef std::function<bool(const CommandArgs& args)> CommandHandler;
+
+	///@brief Runs a query and returns the reply
+	typedef std::function<std::string()> QueryHandler;
+
+	void AddCommand(
+		const std::string& name,
+		CommandArgType type,
+		CommandHandler handler,
+		double minValue = -1e308,
+		double maxValue = 1e308);
+	void AddQuery(const std::string& name, QueryHandler handler);
+
+	bool Command(
+		const std::string& line,
+		const std::string& subject,
+		const std::string& cmd,
+		const std::vector<std::string>& args) const;
+	bool Query(const std::string& subject, const std::string& cmd, std::string& reply) const;
+
+protected:
+	class CommandEntry
+	{
+	public:
+		CommandArgType m_type;
+		double m_min;
+		double m_max;
+		CommandHandler m_handler;
+	};
+
+	///@brief Command name to entry, for each subject ("" for entries that match any subject)
+	template<class T>
+	using SubjectTable = std::unordered_map<std::string, std::unordered_map<std::string, T> >;
+
+	template<class T>
+	static void Insert(SubjectTable<T>& table, const std::string& name, const T& entry);
+
+	template<class T>
+	static const T* Find(const SubjectTable<T>& table, const std::string& subject, const std::string& cmd);
+
+	static bool ParseArgs(const CommandEntry& entry, CommandArgs& args);
+
+	SubjectTable<CommandEntry> m_commands;
+	SubjectTable<QueryHandler> m_queries;
+};
+
+#endif
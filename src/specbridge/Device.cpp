@@ -0,0 +1,439 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Spectrometer connection management
+ */
+
+#include "specbridge.h"
+#include "Device.h"
+#include "Calibration.h"
+#include "Hotplug.h"
+#include "ProcessingPipeline.h"
+#include "Shutdown.h"
+#include "StartupTiming.h"
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+//Re-open the device in-process if acquisition fails, instead of giving up on the data plane
+volatile bool g_restartOnUsbError = false;
+
+//Number of times the device has been successfully recovered since startup
+atomic<uint32_t> g_deviceRecoveries(0);
+
+//True while we have an open connection to the spectrometer
+atomic<bool> g_deviceAttached(false);
+
+//True if the last enumeration found no spectrometer at all, so there's no point retrying until one is plugged in
+static atomic<bool> g_deviceUnplugged(false);
+
+//USB interface serial number of the device we're connected to
+static string g_deviceUsbSerial;
+
+//Serializes opening, closing and re-opening the device. The main thread, the hotplug monitor and the data thread's
+//recovery can all try at once. Always taken before g_mutex.
+static mutex g_lifecycleMutex;
+
+//Delay between recovery attempts, doubling after each failure
+#define RECOVERY_INITIAL_DELAY_MS	100
+#define RECOVERY_MAX_DELAY_MS		10000
+
+//udev may still be fixing up permissions on the hidraw node when we hear about it
+#define ATTACH_ATTEMPTS				10
+#define ATTACH_RETRY_DELAY_MS		200
+
+static vector<string> EnumerateDevices();
+static bool ConnectDevice();
+static bool ConfigureDevice();
+static bool ReadCalSerial(string& serial);
+static bool ReopenDeviceLocked();
+
+/**
+	@brief Connects to the spectrometer, sets it up for acquisition and starts loading its calibration
+
+	@return False if anything failed (the error has already been logged)
+ */
+bool OpenDevice()
+{
+	lock_guard<mutex> lifecycle(g_lifecycleMutex);
+
+	{
+		lock_guard<mutex> lock(g_mutex);
+		if(!ConnectDevice())
+			return false;
+		if(!ConfigureDevice())
+		{
+			disconnectDeviceContext(&g_hDevice);
+			return false;
+		}
+		g_deviceAttached = true;
+	}
+
+	StartCalibrationLoad();
+	return true;
+}
+
+/**
+	@brief Drops the connection to the spectrometer
+ */
+void CloseDevice()
+{
+	lock_guard<mutex> lifecycle(g_lifecycleMutex);
+	lock_guard<mutex> lock(g_mutex);
+	if(g_deviceAttached)
+		disconnectDeviceContext(&g_hDevice);
+	g_deviceAttached = false;
+}
+
+/**
+	@brief Changes the exposure time
+
+	@param ticks	Exposure time, in 10us ticks
+
+	@return False if the device rejected it
+ */
+bool SetExposureTicks(uint32_t ticks)
+{
+	{
+		lock_guard<mutex> lock(g_mutex);
+
+		int err;
+		if(0 != (err = setExposure(ticks, 0, &g_hDevice)))
+		{
+			LogError("failed to set exposure, code %d\n", err);
+			return false;
+		}
+		g_exposure = ticks;
+	}
+
+	//Irradiance normalization depends on exposure time
+	RebuildPipeline();
+	return true;
+}
+
+/**
+	@brief Closes and re-opens the spectrometer after a USB error
+
+	Calibration is kept from the first connection, which saves re-reading the whole flash, unless a different
+	spectrometer turns up on the bus (or it never loaded in the first place).
+
+	@return False if the device could not be re-opened
+ */
+bool ReopenDevice()
+{
+	lock_guard<mutex> lifecycle(g_lifecycleMutex);
+	return ReopenDeviceLocked();
+}
+
+/**
+	@brief Does the work of ReopenDevice(). Call with g_lifecycleMutex held.
+ */
+static bool ReopenDeviceLocked()
+{
+	//Let any calibration load in progress finish (or fail) first, so it isn't reading flash while we reconnect
+	JoinCalibrationLoad();
+	auto cal = TryGetCalibration();
+
+	bool calChanged = false;
+	{
+		lock_guard<mutex> lock(g_mutex);
+
+		LogNotice("Re-opening spectrometer\n");
+		if(g_deviceAttached)
+			disconnectDeviceContext(&g_hDevice);
+		g_deviceAttached = false;
+		if(!ConnectDevice())
+			return false;
+
+		//From here on, failing has to drop the connection we just made. It isn't attached yet, so nobody else will.
+		string serial;
+		if(!ReadCalSerial(serial))
+		{
+			disconnectDeviceContext(&g_hDevice);
+			return false;
+		}
+		if(!cal)
+			calChanged = true;
+		else if(serial != cal->m_serial)
+		{
+			LogWarning("Spectrometer serial changed from %s to %s, reloading calibration\n",
+				cal->m_serial.c_str(), serial.c_str());
+			calChanged = true;
+		}
+
+		if(!ConfigureDevice())
+		{
+			disconnectDeviceContext(&g_hDevice);
+			return false;
+		}
+		g_deviceAttached = true;
+	}
+
+	//Pipeline is rebuilt against the new tables once they've loaded
+	if(calChanged)
+		StartCalibrationLoad();
+
+	LogNotice("Spectrometer re-opened\n");
+	return true;
+}
+
+/**
+	@brief Keeps trying to re-open the device after an acquisition failure, backing off between attempts
+
+	The first attempt is immediate, since a single failed transfer on a flaky hub often recovers straight away.
+	Later attempts back off so a device that's been unplugged doesn't get hammered. If the hotplug monitor is running
+	it re-attaches the device when it comes back, so we don't retry while the bus is empty. Without it we keep
+	retrying, since re-enumerating in ReopenDevice() is the only way to notice the device is back.
+
+	@return True once the device is back, false if we were told to stop first
+ */
+bool RecoverDevice()
+{
+	auto delay = chrono::milliseconds(RECOVERY_INITIAL_DELAY_MS);
+	for(unsigned int attempt = 1; !g_waveformThreadQuit; attempt++)
+	{
+		//Nothing to retry while there's no spectrometer on the bus, as long as hotplug will tell us when there is
+		if(!g_deviceUnplugged || !IsHotplugMonitorRunning())
+		{
+			if(ReopenDevice())
+			{
+				g_deviceRecoveries ++;
+				LogNotice("Recovered spectrometer after %u attempt(s)\n", attempt);
+				return true;
+			}
+
+			LogWarning("Recovery attempt %u failed, retrying in %u ms\n", attempt, (unsigned int)delay.count());
+		}
+
+		//Sleep in small steps so shutdown isn't held up by a long backoff
+		auto deadline = chrono::steady_clock::now() + delay;
+		while(!g_waveformThreadQuit && !g_deviceAttached && (chrono::steady_clock::now() < deadline) )
+			this_thread::sleep_for(chrono::milliseconds(10));
+
+		if(g_deviceAttached)
+		{
+			g_deviceRecoveries ++;
+			LogNotice("Spectrometer was re-attached\n");
+			return true;
+		}
+
+		delay = min(delay * 2, chrono::milliseconds(RECOVERY_MAX_DELAY_MS));
+	}
+	return false;
+}
+
+/**
+	@brief Called by the hotplug monitor when a hidraw device appears
+
+	Connects to it if we don't already have a spectrometer and it turns out to be one.
+ */
+void OnDeviceArrived()
+{
+	if(g_deviceAttached)
+	{
+		LogDebug("Ignoring new hidraw device, already have a spectrometer\n");
+		return;
+	}
+
+	//Could be a keyboard or anything else
+	{
+		lock_guard<mutex> lock(g_mutex);
+		if(EnumerateDevices().empty())
+		{
+			LogDebug("New hidraw device is not a spectrometer\n");
+			return;
+		}
+	}
+
+	LogNotice("Spectrometer plugged in\n");
+	for(unsigned int attempt = 0; attempt < ATTACH_ATTEMPTS; attempt++)
+	{
+		{
+			//Recovery on the data thread may have got there first
+			lock_guard<mutex> lifecycle(g_lifecycleMutex);
+			if(g_deviceAttached)
+				return;
+			if(ReopenDeviceLocked())
+				return;
+		}
+		if(g_shutdownRequested)
+			return;
+		this_thread::sleep_for(chrono::milliseconds(ATTACH_RETRY_DELAY_MS));
+	}
+	LogError("Could not open newly attached spectrometer\n");
+}
+
+/**
+	@brief Called by the hotplug monitor when a hidraw device goes away
+
+	Drops the connection if it was our spectrometer, so acquisition waits for it to come back instead of erroring.
+ */
+void OnDeviceRemoved()
+{
+	lock_guard<mutex> lifecycle(g_lifecycleMutex);
+	lock_guard<mutex> lock(g_mutex);
+
+	if(!g_deviceAttached)
+		return;
+
+	auto serials = EnumerateDevices();
+	if(find(serials.begin(), serials.end(), g_deviceUsbSerial) != serials.end())
+		return;
+
+	LogWarning("Spectrometer %s unplugged\n", g_deviceUsbSerial.c_str());
+	disconnectDeviceContext(&g_hDevice);
+	g_deviceAttached = false;
+}
+
+/**
+	@brief Gets the USB interface serial numbers of all spectrometers on the bus. Call with g_mutex held.
+ */
+static vector<string> EnumerateDevices()
+{
+	vector<string> serials;
+	auto info = getDevicesInfo();
+	for(DeviceInfo_t* p = info; p != nullptr; p = p->next)
+		serials.push_back(p->serialNumber);
+	clearDevicesInfo(info);
+
+	g_deviceUnplugged = serials.empty();
+	return serials;
+}
+
+/**
+	@brief Connects to the first spectrometer on the bus. Call with g_mutex held.
+ */
+static bool ConnectDevice()
+{
+	//Try to find a spectrometer
+	StartupPhase enumPhase("enumerate");
+	auto serials = EnumerateDevices();
+	LogDebug("Found %zu spectrometer(s)\n", serials.size());
+	for(auto& serial : serials)
+	{
+		LogIndenter li;
+		LogDebug("S/N: %s\n", serial.c_str());
+	}
+	enumPhase.Done();
+
+	if(serials.empty())
+	{
+		LogError("no spectrometers found\n");
+		return false;
+	}
+
+	//Connect to the device
+	//connectToDeviceBySerial seems broken! always outputs null...
+	unsigned int ndevice = 0;
+	LogDebug("Connecting to spectrometer with USB interface serial %s...\n", serials[ndevice].c_str());
+	StartupPhase connectPhase("connect");
+	int err;
+	if(0 != (err = connectToDeviceByIndex(ndevice, &g_hDevice) ))
+	{
+		LogError("failed to connect to device code %d\n", err);
+		if(err == CONNECT_ERROR_FAILED)
+			LogNotice("CONNECT_ERROR_FAILED, check permissions on /dev/hidrawX file\n");
+		return false;
+	}
+	g_deviceUsbSerial = serials[ndevice];
+	LogNotice("Successfully opened instrument\n");
+	return true;
+}
+
+/**
+	@brief Sets up frame format, exposure and triggering. Call with g_mutex held.
+ */
+static bool ConfigureDevice()
+{
+	//Set initial frame format
+	//Frame contains 32 dummy pixels, valid data, 14 dummy pixels
+	StartupPhase phase("configure");
+	int err;
+	uint16_t framesize;
+	if(0 != (err = setFrameFormat(0, g_numPixels-1, 0, &framesize, &g_hDevice)))
+	{
+		LogError("failed to set frame format, code %d\n", err);
+		return false;
+	}
+	//LogDebug("framesize = %d\n", framesize);
+
+	//Set exposure, in 10us units
+	if(0 != (err = setExposure(g_exposure, 0, &g_hDevice)))
+	{
+		LogError("failed to set exposure, code %d\n", err);
+		return false;
+	}
+
+	//Set acquisition parameters to free run capture with no averaging
+	if(0 != (err = setAcquisitionParameters(1, 0, 0, g_exposure, &g_hDevice)))
+	{
+		LogError("failed to set acquisition parameters, code %d\n", err);
+		return false;
+	}
+
+	//Do not use external trigger
+	if(0 != (err = setExternalTrigger(0, 0, &g_hDevice)))
+	{
+		LogError("failed to set trigger mode, code %d\n", err);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+	@brief Reads just the serial number from the first line of the calibration data. Call with g_mutex held.
+ */
+static bool ReadCalSerial(string& serial)
+{
+	const int nhead = 128;
+	char buf[nhead+1];
+	int err;
+	if(0 != (err = readFlash((uint8_t*)buf, 0, nhead, &g_hDevice)))
+	{
+		LogError("failed to read cal data, code %d\n", err);
+		return false;
+	}
+	buf[nhead] = '\0';
+
+	//First line: model c.[Y|N] serial
+	string model;
+	bool hasAbsCal;
+	auto eol = strchr(buf, '\n');
+	if(!Calibration::ParseHeader(buf, eol ? (eol - buf) : nhead, model, hasAbsCal, serial))
+	{
+		LogError("malformed cal data header\n");
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,198 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of EventCapture
+ */
+
+#include "specbridge.h"
+#include "Acquisition.h"
+#include "EventCapture.h"
+#include <math.h>
+
+using namespace std;
+
+//Only send frames around software triggers
+volatile bool g_eventCapture = false;
+
+//Frames to send before and after each trigger. The trigger frame counts as the first post-trigger frame.
+static atomic<size_t> g_eventPre(0);
+static atomic<size_t> g_eventPost(1);
+
+//CLOCK_MONOTONIC of a trigger that hasn't been picked up by the data thread yet, zero if none
+static atomic<int64_t> g_eventTrigger(0);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Settings
+
+/**
+	@brief Sets how many frames each event contains
+
+	@param pre	Frames before the trigger
+	@param post	Frames from the trigger on, including the one exposing when it fired
+
+	@return False if post is zero, or the event wouldn't fit in the send ring
+ */
+bool SetEventFrames(size_t pre, size_t post)
+{
+	//The whole event is queued at once, any more than the ring holds and the oldest would be dropped
+	if( (post < 1) || (pre + post > g_ringDepth) )
+	{
+		LogError("Events must have at least one post-trigger frame and no more than %zu frames in total\n",
+			g_ringDepth);
+		return false;
+	}
+
+	g_eventPre = pre;
+	g_eventPost = post;
+	return true;
+}
+
+/**
+	@brief Sets the number of pre-trigger frames from a trigger delay, at the current frame rate
+
+	If no frame rate is set, uses the fastest rate the current exposure allows.
+ */
+bool SetEventDelay(uint64_t delay_fs)
+{
+	double rate = GetFrameRate();
+	if(rate <= 0)
+		rate = GetMaxFrameRate();
+	if(rate <= 0)
+		return false;
+
+	size_t pre = llround(delay_fs * 1e-15 * rate);
+	size_t post = g_eventPost;
+	if(pre + post > g_ringDepth)
+	{
+		LogWarning("Trigger delay is longer than the send ring holds, using %zu pre-trigger frames\n",
+			g_ringDepth - post);
+		pre = g_ringDepth - post;
+	}
+
+	LogVerbose("Trigger delay of %.3f ms is %zu frames at %.3f Hz\n", delay_fs * 1e-12, pre, rate);
+	return SetEventFrames(pre, post);
+}
+
+size_t GetEventPreFrames()
+{
+	return g_eventPre;
+}
+
+size_t GetEventPostFrames()
+{
+	return g_eventPost;
+}
+
+/**
+	@brief Software trigger for event capture. Ignored if an event is already being captured.
+ */
+void FireEvent()
+{
+	g_eventTrigger = GetMonotonicTime();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// EventCapture
+
+EventCapture::EventCapture()
+	: m_capturing(false)
+	, m_triggerTime(0)
+	, m_postRemaining(0)
+{
+}
+
+void EventCapture::Reset()
+{
+	m_history.clear();
+	m_event.clear();
+	m_capturing = false;
+}
+
+/**
+	@brief Takes the next processed frame, in sequence order
+
+	@param frame	The frame
+	@param ready	Frames to send are appended here
+ */
+void EventCapture::Offer(shared_ptr<Frame> frame, vector<shared_ptr<Frame> >& ready)
+{
+	if(!g_eventCapture)
+	{
+		if(!m_history.empty() || m_capturing)
+			Reset();
+		g_eventTrigger = 0;
+		ready.push_back(frame);
+		return;
+	}
+
+	//Pick up a new trigger. Any that arrive while we're busy with one are dropped.
+	int64_t trigger = g_eventTrigger.exchange(0);
+	if(trigger && !m_capturing)
+	{
+		m_capturing = true;
+		m_triggerTime = trigger;
+		m_postRemaining = g_eventPost;
+	}
+	else if(trigger)
+		LogVerbose("Ignoring trigger, still capturing the last event\n");
+
+	//Anything that finished exposing before the trigger is history
+	int64_t exposureEnd = frame->m_midExposure + frame->m_exposure * 5000LL;
+	if(!m_capturing || (exposureEnd <= m_triggerTime) )
+	{
+		m_history.push_back(frame);
+		while(m_history.size() > g_eventPre)
+			m_history.pop_front();
+		return;
+	}
+
+	//First frame after the trigger: everything in the history comes along as pre-trigger frames
+	if(m_event.empty())
+	{
+		for(auto& f : m_history)
+		{
+			f->m_flags |= FRAME_FLAG_PRETRIGGER;
+			m_event.push_back(f);
+		}
+		m_history.clear();
+		frame->m_flags |= FRAME_FLAG_TRIGGER;
+	}
+	m_event.push_back(frame);
+
+	//Release the whole event at once. Start the next history from scratch so no frame is sent twice.
+	if(--m_postRemaining == 0)
+	{
+		ready.insert(ready.end(), m_event.begin(), m_event.end());
+		m_event.clear();
+		m_capturing = false;
+	}
+}
@@ -0,0 +1,86 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of EventCapture
+ */
+
+#ifndef EventCapture_h
+#define EventCapture_h
+
+#include "Frame.h"
+#include <deque>
+#include <stdint.h>
+
+extern volatile bool g_eventCapture;
+
+bool SetEventFrames(size_t pre, size_t post);
+bool SetEventDelay(uint64_t delay_fs);
+size_t GetEventPreFrames();
+size_t GetEventPostFrames();
+void FireEvent();
+
+/**
+	@brief Holds processed frames back in event capture mode, releasing them only around a software trigger
+
+	Frames are kept in a rolling history of the last M. When a trigger arrives, the frame that was exposing at the
+	time and the N-1 after it are collected, then all M+N are released together. Frames that aren't part of an event
+	are never sent. With event capture off every frame passes straight through.
+
+	One instance is owned by each data thread, which offers it frames in sequence order.
+ */
+class EventCapture
+{
+public:
+	EventCapture();
+
+	void Offer(std::shared_ptr<Frame> frame, std::vector<std::shared_ptr<Frame> >& ready);
+
+protected:
+	void Reset();
+
+	///@brief Most recent frames not part of an event, oldest first
+	std::deque<std::shared_ptr<Frame> > m_history;
+
+	///@brief Frames of the event being captured, pre-trigger frames first
+	std::vector<std::shared_ptr<Frame> > m_event;
+
+	///@brief True if we've picked up a trigger and are collecting its event
+	bool m_capturing;
+
+	///@brief CLOCK_MONOTONIC when the trigger being captured was fired
+	int64_t m_triggerTime;
+
+	///@brief Post-trigger frames still to collect
+	size_t m_postRemaining;
+};
+
+#endif
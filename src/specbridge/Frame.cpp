@@ -0,0 +1,112 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of Frame
+ */
+
+#include "specbridge.h"
+#include "Frame.h"
+#include "ProcessingPipeline.h"
+
+using namespace std;
+
+/**
+	@brief Fills out the data plane header for one channel of this frame
+
+	@param header	Header to fill out
+	@param channel	Index into m_channels
+ */
+void Frame::GetHeader(FrameHeader& header, size_t channel) const
+{
+	header.m_magic = FRAME_MAGIC;
+	header.m_version = FRAME_VERSION;
+	header.m_headerLength = sizeof(FrameHeader);
+	header.m_sequence = m_sequence;
+	auto& ch = m_channels[channel];
+	header.m_sampleCount = ch.GetSampleCount();
+	header.m_exposure = m_exposure;
+	header.m_triggerMono = m_trigger.m_mono;
+	header.m_readoutStartMono = m_readoutStart;
+	header.m_readoutEndMono = m_readoutEnd;
+	header.m_midExposureMono = m_midExposure;
+	header.m_midExposureReal = m_trigger.MonoToReal(m_midExposure);
+	header.m_midExposureRef = m_trigger.MonoToRef(m_midExposure);
+	header.m_refClock = m_trigger.m_ref ? GetReferenceClock() : REFCLOCK_NONE;
+	header.m_flags = m_flags;
+	header.m_channel = ch.m_index;
+	header.m_sampleFormat = ch.m_quantizer.GetFormat();
+	header.m_scale = ch.m_quantizer.GetScale();
+	header.m_offset = ch.m_quantizer.GetOffset();
+}
+
+/**
+	@brief True if any channel's pipeline is expensive enough to be worth running on the worker pool
+ */
+bool Frame::IsHeavy() const
+{
+	for(auto& channel : m_channels)
+	{
+		if(channel.m_pipeline->IsHeavy())
+			return true;
+	}
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FrameChannel
+
+size_t FrameChannel::GetSampleCount() const
+{
+	if(m_quantizer.IsQuantized())
+		return m_packed.size() / m_quantizer.GetSampleSize();
+	return m_samples.size();
+}
+
+/**
+	@brief Start of the data to send for this channel
+ */
+const void* FrameChannel::GetPayload() const
+{
+	if(m_quantizer.IsQuantized())
+		return m_packed.data();
+	return m_samples.data();
+}
+
+/**
+	@brief Number of bytes to send for this channel
+ */
+size_t FrameChannel::GetPayloadSize() const
+{
+	if(m_quantizer.IsQuantized())
+		return m_packed.size();
+	return m_samples.size() * sizeof(float);
+}
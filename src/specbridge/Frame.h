@@ -0,0 +1,211 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of Frame
+ */
+
+#ifndef Frame_h
+#define Frame_h
+
+#include "Quantizer.h"
+#include "Timestamps.h"
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+class ProcessingPipeline;
+
+#pragma pack(push, 1)
+
+/**
+	@brief Header sent ahead of each frame's samples on the data plane, if enabled with FRAMEHEADER
+
+	All fields are little endian. Timestamps are in nanoseconds. New fields are only ever appended, so clients should
+	use m_headerLength to find the start of the samples rather than sizeof(FrameHeader).
+
+	Each enabled channel is sent as its own block (header, if enabled, then samples), in channel order. With only C1
+	enabled (the default) there is one block per frame.
+ */
+class FrameHeader
+{
+public:
+	///@brief Always FRAME_MAGIC
+	uint32_t m_magic;
+
+	///@brief Always FRAME_VERSION
+	uint16_t m_version;
+
+	///@brief Size of this header, in bytes
+	uint16_t m_headerLength;
+
+	///@brief Position in the acquisition sequence
+	uint64_t m_sequence;
+
+	///@brief Number of samples following the header, for this channel (each m_sampleFormat wide)
+	uint32_t m_sampleCount;
+
+	///@brief Exposure time, in 10us ticks
+	uint32_t m_exposure;
+
+	///@brief CLOCK_MONOTONIC when the exposure was triggered
+	int64_t m_triggerMono;
+
+	///@brief CLOCK_MONOTONIC at the start and end of the USB readout of this frame
+	int64_t m_readoutStartMono;
+	int64_t m_readoutEndMono;
+
+	///@brief Estimated midpoint of the exposure, in CLOCK_MONOTONIC, CLOCK_REALTIME and the reference clock
+	int64_t m_midExposureMono;
+	int64_t m_midExposureReal;
+	int64_t m_midExposureRef;
+
+	///@brief Which reference clock m_midExposureRef is from (a ReferenceClock)
+	uint32_t m_refClock;
+
+	///@brief FRAME_FLAG_* bits
+	uint32_t m_flags;
+
+	///@brief Which channel the samples are from, zero based (a ChannelIndex)
+	uint32_t m_channel;
+
+	///@brief How the samples are encoded (a SampleFormat)
+	uint32_t m_sampleFormat;
+
+	///@brief For integer formats, value = code*m_scale + m_offset. 1 and 0 for float32.
+	float m_scale;
+	float m_offset;
+};
+
+#pragma pack(pop)
+
+#define FRAME_MAGIC		0x51455341	//"ASEQ"
+#define FRAME_VERSION	1
+
+///@brief Frames were lost immediately before this one (device recovery, or the client not keeping up)
+#define FRAME_FLAG_GAP	0x00000001
+
+///@brief Event capture: frame was acquired before the trigger
+#define FRAME_FLAG_PRETRIGGER	0x00000002
+
+///@brief Event capture: frame was exposing when the trigger fired (first post-trigger frame)
+#define FRAME_FLAG_TRIGGER		0x00000004
+
+///@brief Change detection: frame was sent because a keyframe was due, not because it changed
+#define FRAME_FLAG_KEYFRAME		0x00000008
+
+/**
+	@brief Processed output of one channel of a frame
+ */
+class FrameChannel
+{
+public:
+	///@brief Which channel this is (a ChannelIndex)
+	uint32_t m_index;
+
+	FrameChannel()
+	: m_index(0)
+	{}
+
+	size_t GetSampleCount() const;
+	const void* GetPayload() const;
+	size_t GetPayloadSize() const;
+
+	///@brief The pipeline that was current for this channel when the frame was acquired
+	std::shared_ptr<const ProcessingPipeline> m_pipeline;
+
+	///@brief Encoding the channel's settings called for when the frame was acquired
+	Quantizer m_quantizer;
+
+	///@brief Processed data, ready to send unless the channel is quantized
+	std::vector<float> m_samples;
+
+	///@brief Quantized data, ready to send (empty if not quantized)
+	std::vector<uint8_t> m_packed;
+};
+
+/**
+	@brief A single acquired frame as it moves from the device, through processing, to the client
+ */
+class Frame
+{
+public:
+	Frame()
+	: m_sequence(0)
+	, m_exposure(0)
+	, m_readoutStart(0)
+	, m_readoutEnd(0)
+	, m_midExposure(0)
+	, m_flags(0)
+	{}
+
+	void GetHeader(FrameHeader& header, size_t channel) const;
+	bool IsHeavy() const;
+
+	///@brief Number of 16-bit words returned by getFrame(): 32 dummy pixels, valid data, 14 dummy pixels
+	static const size_t RAW_SIZE = 3699;
+
+	///@brief Offset of the first valid pixel in m_raw
+	static const size_t RAW_OFFSET = 32;
+
+	///@brief Position of this frame in the acquisition sequence, used to deliver frames in order
+	uint64_t m_sequence;
+
+	///@brief Raw pixel data as read from the device
+	std::vector<uint16_t> m_raw;
+
+	///@brief Exposure time, in 10us ticks
+	uint32_t m_exposure;
+
+	///@brief Host clocks, sampled just after the exposure was triggered
+	ClockSample m_trigger;
+
+	///@brief CLOCK_MONOTONIC at the start and end of the USB readout
+	int64_t m_readoutStart;
+	int64_t m_readoutEnd;
+
+	///@brief Estimated CLOCK_MONOTONIC at the midpoint of the exposure
+	int64_t m_midExposure;
+
+	///@brief FRAME_FLAG_* bits
+	uint32_t m_flags;
+
+	///@brief Enabled channels, in channel order
+	std::vector<FrameChannel> m_channels;
+
+	///@brief Working buffer for block processing stages
+	std::vector<float> m_scratch;
+
+	///@brief Mean of each band of the first channel after the conversion pass, for change detection (empty if off)
+	std::vector<float> m_bands;
+};
+
+#endif
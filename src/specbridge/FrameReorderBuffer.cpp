@@ -0,0 +1,83 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FrameReorderBuffer
+ */
+
+#include "specbridge.h"
+#include "FrameReorderBuffer.h"
+
+using namespace std;
+
+FrameReorderBuffer::FrameReorderBuffer()
+	: m_nextSequence(0)
+{
+}
+
+/**
+	@brief Marks a frame as finished. May be called from any thread.
+ */
+void FrameReorderBuffer::Complete(shared_ptr<Frame> frame)
+{
+	bool next;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		next = (frame->m_sequence == m_nextSequence);
+		m_done[frame->m_sequence] = frame;
+	}
+
+	if(next)
+		m_ready.notify_one();
+}
+
+/**
+	@brief Gets the next frame in sequence order
+
+	@param block	If true, wait until the next frame is finished. If false, return immediately.
+
+	@return The frame, or null if it's not finished yet and block is false
+ */
+shared_ptr<Frame> FrameReorderBuffer::PopNext(bool block)
+{
+	unique_lock<mutex> lock(m_mutex);
+	if(block)
+		m_ready.wait(lock, [this]{ return m_done.count(m_nextSequence) != 0; });
+
+	auto it = m_done.find(m_nextSequence);
+	if(it == m_done.end())
+		return nullptr;
+
+	auto frame = it->second;
+	m_done.erase(it);
+	m_nextSequence ++;
+	return frame;
+}
@@ -0,0 +1,155 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FrameRing
+ */
+
+#include "specbridge.h"
+#include "FrameRing.h"
+
+using namespace std;
+
+FrameRing::FrameRing(size_t capacity)
+	: m_capacity(max(capacity, (size_t)1))
+	, m_closed(false)
+	, m_dropped(0)
+{
+}
+
+/**
+	@brief Queues a frame for sending, dropping the oldest queued frame if the ring is full
+
+	@return False if the ring has been closed
+ */
+bool FrameRing::Push(shared_ptr<Frame> frame)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(m_closed)
+			return false;
+		PushLocked(frame);
+	}
+	m_notEmpty.notify_one();
+	return true;
+}
+
+/**
+	@brief Queues several frames at once, so the sender picks them up together
+
+	@return False if the ring has been closed
+ */
+bool FrameRing::Push(const vector<shared_ptr<Frame> >& frames)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(m_closed)
+			return false;
+		for(auto& frame : frames)
+			PushLocked(frame);
+	}
+	m_notEmpty.notify_one();
+	return true;
+}
+
+/**
+	@brief Queues a frame, dropping the oldest if full. Must be called with m_mutex held.
+ */
+void FrameRing::PushLocked(shared_ptr<Frame> frame)
+{
+	if(m_frames.size() >= m_capacity)
+	{
+		if(m_dropped == 0)
+			LogWarning("Data plane client isn't keeping up, dropping frames\n");
+		m_frames.pop_front();
+		m_dropped ++;
+
+		//Let the client know the stream isn't contiguous here
+		if(!m_frames.empty())
+			m_frames.front().second->m_flags |= FRAME_FLAG_GAP;
+		else
+			frame->m_flags |= FRAME_FLAG_GAP;
+	}
+
+	m_frames.push_back(make_pair(chrono::steady_clock::now(), frame));
+}
+
+/**
+	@brief Waits for frames to send
+
+	Blocks until at least one frame is available, then keeps collecting frames until either maxFrames are queued or
+	the oldest one has been waiting for latencyBudget.
+
+	@param batch			Frames to send (replaced, not appended to)
+	@param maxFrames		Maximum number of frames to return
+	@param latencyBudget	Longest a frame may be held back waiting for others to share its batch
+
+	@return False if the ring has been closed and there is nothing left to send
+ */
+bool FrameRing::PopBatch(
+	vector<shared_ptr<Frame> >& batch,
+	size_t maxFrames,
+	chrono::microseconds latencyBudget)
+{
+	batch.clear();
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]{ return m_closed || !m_frames.empty(); });
+		if(m_frames.empty())
+			return false;
+
+		if(latencyBudget.count() > 0)
+		{
+			auto deadline = m_frames.front().first + latencyBudget;
+			m_notEmpty.wait_until(lock, deadline, [this, maxFrames]
+				{ return m_closed || (m_frames.size() >= maxFrames); });
+		}
+
+		while(!m_frames.empty() && (batch.size() < maxFrames) )
+		{
+			batch.push_back(m_frames.front().second);
+			m_frames.pop_front();
+		}
+	}
+	return true;
+}
+
+/**
+	@brief Wakes up everyone waiting on the ring and makes all further pushes fail
+ */
+void FrameRing::Close()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_closed = true;
+	}
+	m_notEmpty.notify_all();
+}
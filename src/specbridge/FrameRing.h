@@ -0,0 +1,88 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FrameRing
+ */
+
+#ifndef FrameRing_h
+#define FrameRing_h
+
+#include "Frame.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+	@brief Bounded queue of processed frames between the data thread and the network sender
+
+	The sender pulls frames out in batches so several small frames can go out in a single system call.
+
+	Pushing never blocks, so acquisition keeps running if the client stalls. Once the ring is full the oldest frames
+	are dropped, and the gap shows up in the sequence numbers.
+ */
+class FrameRing
+{
+public:
+	FrameRing(size_t capacity);
+
+	bool Push(std::shared_ptr<Frame> frame);
+	bool Push(const std::vector<std::shared_ptr<Frame> >& frames);
+	bool PopBatch(
+		std::vector<std::shared_ptr<Frame> >& batch,
+		size_t maxFrames,
+		std::chrono::microseconds latencyBudget);
+	void Close();
+
+	uint64_t GetDropCount()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_dropped;
+	}
+
+protected:
+	void PushLocked(std::shared_ptr<Frame> frame);
+
+	std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+
+	size_t m_capacity;
+	bool m_closed;
+
+	///@brief Number of frames thrown away because the ring was full
+	uint64_t m_dropped;
+
+	///@brief Queued frames and when each was queued
+	std::deque<std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<Frame> > > m_frames;
+};
+
+#endif
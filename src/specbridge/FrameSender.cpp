@@ -0,0 +1,189 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FrameSender
+ */
+
+#include "specbridge.h"
+#include "FrameSender.h"
+#include "UringFrameSender.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <errno.h>
+#include <limits.h>
+#endif
+
+using namespace std;
+
+FrameSenderType g_frameSenderType = SENDER_SOCKET;
+
+bool ParseFrameSenderType(const string& name, FrameSenderType& type)
+{
+	if(name == "socket")
+		type = SENDER_SOCKET;
+#ifdef HAVE_LIBURING
+	else if(name == "uring")
+		type = SENDER_URING;
+#endif
+	else
+		return false;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FrameSender
+
+FrameSender::~FrameSender()
+{
+}
+
+/**
+	@brief Creates the sender for a newly connected client
+ */
+unique_ptr<FrameSender> FrameSender::Create(Socket& socket)
+{
+#ifdef HAVE_LIBURING
+	if(g_frameSenderType == SENDER_URING)
+	{
+		auto sender = new UringFrameSender(socket);
+		if(sender->IsOpen())
+			return unique_ptr<FrameSender>(sender);
+		delete sender;
+		LogWarning("Falling back to blocking sends\n");
+	}
+#endif
+
+	return unique_ptr<FrameSender>(new SocketFrameSender(socket));
+}
+
+/**
+	@brief Fills m_headers with one header per channel of each frame, in send order (or nothing, if headers are
+	disabled)
+ */
+void FrameSender::GetHeaders(const vector<shared_ptr<Frame> >& frames)
+{
+	m_headers.clear();
+	if(!g_frameHeaders)
+		return;
+
+	for(auto& frame : frames)
+	{
+		for(size_t i=0; i<frame->m_channels.size(); i++)
+		{
+			m_headers.push_back(FrameHeader());
+			frame->GetHeader(m_headers.back(), i);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SocketFrameSender
+
+SocketFrameSender::SocketFrameSender(Socket& socket)
+	: m_socket(socket)
+{
+}
+
+bool SocketFrameSender::Send(const vector<shared_ptr<Frame> >& frames)
+{
+	GetHeaders(frames);
+
+#ifdef _WIN32
+
+	//No scatter-gather, one send per buffer
+	size_t block = 0;
+	for(auto& frame : frames)
+	{
+		for(auto& channel : frame->m_channels)
+		{
+			if(!m_headers.empty() && !m_socket.SendLooped((uint8_t*)&m_headers[block], sizeof(FrameHeader)))
+				return false;
+			block ++;
+
+			if(!m_socket.SendLooped((uint8_t*)channel.GetPayload(), channel.GetPayloadSize()))
+				return false;
+		}
+	}
+	return true;
+
+#else
+
+	//Gather headers and payloads straight from the frames, no copying
+	vector<iovec> iov;
+	iov.reserve(frames.size() * 2);
+	size_t block = 0;
+	for(auto& frame : frames)
+	{
+		for(auto& channel : frame->m_channels)
+		{
+			if(!m_headers.empty())
+				iov.push_back({ &m_headers[block], sizeof(FrameHeader) });
+			block ++;
+
+			iov.push_back({ const_cast<void*>(channel.GetPayload()), channel.GetPayloadSize() });
+		}
+	}
+
+	//Short writes are normal for large batches, pick up where the kernel left off
+	ZSOCKET sock = m_socket;
+	size_t first = 0;
+	while(first < iov.size())
+	{
+		msghdr msg = {};
+		msg.msg_iov = &iov[first];
+		msg.msg_iovlen = min(iov.size() - first, (size_t)IOV_MAX);
+
+		ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+		if(sent < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+
+		size_t remaining = sent;
+		while( (first < iov.size()) && (remaining >= iov[first].iov_len) )
+		{
+			remaining -= iov[first].iov_len;
+			first ++;
+		}
+		if(remaining)
+		{
+			iov[first].iov_base = (uint8_t*)iov[first].iov_base + remaining;
+			iov[first].iov_len -= remaining;
+		}
+	}
+	return true;
+
+#endif
+}
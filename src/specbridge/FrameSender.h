@@ -0,0 +1,96 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FrameSender
+ */
+
+#ifndef FrameSender_h
+#define FrameSender_h
+
+#include "Frame.h"
+#include "../../lib/xptools/Socket.h"
+
+/**
+	@brief Which FrameSender implementation to use for new clients
+ */
+enum FrameSenderType
+{
+	///@brief Blocking scatter-gather writes
+	SENDER_SOCKET,
+
+	///@brief Asynchronous sends through io_uring (Linux, if built with liburing)
+	SENDER_URING
+};
+
+extern FrameSenderType g_frameSenderType;
+
+bool ParseFrameSenderType(const std::string& name, FrameSenderType& type);
+
+/**
+	@brief Sends batches of processed frames to a data plane client
+ */
+class FrameSender
+{
+public:
+	virtual ~FrameSender();
+
+	/**
+		@brief Sends a batch of frames, each preceded by its header if headers are enabled
+
+		@return False if the client disconnected or the send failed
+	 */
+	virtual bool Send(const std::vector<std::shared_ptr<Frame> >& frames) =0;
+
+	static std::unique_ptr<FrameSender> Create(Socket& socket);
+
+protected:
+	void GetHeaders(const std::vector<std::shared_ptr<Frame> >& frames);
+
+	///@brief Headers for the batch being sent. Must stay put until the send completes.
+	std::vector<FrameHeader> m_headers;
+};
+
+/**
+	@brief Blocking sender that writes each batch with a single scatter-gather call where the platform allows it
+ */
+class SocketFrameSender : public FrameSender
+{
+public:
+	SocketFrameSender(Socket& socket);
+
+	virtual bool Send(const std::vector<std::shared_ptr<Frame> >& frames) override;
+
+protected:
+	Socket& m_socket;
+};
+
+#endif
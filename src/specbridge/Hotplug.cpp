@@ -0,0 +1,213 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Spectrometer hotplug monitoring
+
+	Listens for kernel uevents on a netlink socket rather than polling the bus, and hands hidraw add/remove events
+	to the device code, which works out whether they were for a spectrometer. Linux only.
+ */
+
+#include "specbridge.h"
+#include "Device.h"
+#include "Hotplug.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+//Kernel uevent multicast group (udev rebroadcasts on group 2, in its own format)
+#define UEVENT_GROUP_KERNEL	1
+
+static thread g_hotplugThread;
+static int g_ueventSocket = -1;
+static int g_hotplugWakePipe[2] = {-1, -1};
+
+static void HotplugThread();
+static void OnUevent(const char* buf, size_t len);
+
+/**
+	@brief Starts watching for spectrometers being plugged in or removed
+
+	@return False if the netlink socket could not be opened
+ */
+bool StartHotplugMonitor()
+{
+	g_ueventSocket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if(g_ueventSocket < 0)
+	{
+		LogError("failed to open uevent socket: %s\n", strerror(errno));
+		return false;
+	}
+
+	sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = UEVENT_GROUP_KERNEL;
+	if(0 != bind(g_ueventSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+	{
+		LogError("failed to bind uevent socket: %s\n", strerror(errno));
+		close(g_ueventSocket);
+		g_ueventSocket = -1;
+		return false;
+	}
+
+	if(0 != pipe(g_hotplugWakePipe))
+	{
+		LogError("failed to create hotplug wake pipe: %s\n", strerror(errno));
+		close(g_ueventSocket);
+		g_ueventSocket = -1;
+		return false;
+	}
+
+	g_hotplugThread = thread(HotplugThread);
+	LogVerbose("Watching for spectrometer hotplug events\n");
+	return true;
+}
+
+/**
+	@brief Stops the hotplug thread and waits for any attach in progress to finish
+ */
+void StopHotplugMonitor()
+{
+	if(!g_hotplugThread.joinable())
+		return;
+
+	char c = 0;
+	if(write(g_hotplugWakePipe[1], &c, 1) != 1)
+		LogWarning("failed to wake hotplug thread\n");
+	g_hotplugThread.join();
+
+	close(g_ueventSocket);
+	close(g_hotplugWakePipe[0]);
+	close(g_hotplugWakePipe[1]);
+	g_ueventSocket = -1;
+	g_hotplugWakePipe[0] = -1;
+	g_hotplugWakePipe[1] = -1;
+}
+
+bool IsHotplugMonitorRunning()
+{
+	return g_hotplugThread.joinable();
+}
+
+static void HotplugThread()
+{
+	pthread_setname_np(pthread_self(), "Hotplug");
+
+	//Uevents are small, but a whole message has to fit or it's truncated
+	char buf[8192];
+	while(true)
+	{
+		pollfd fds[2];
+		fds[0].fd = g_ueventSocket;
+		fds[0].events = POLLIN;
+		fds[1].fd = g_hotplugWakePipe[0];
+		fds[1].events = POLLIN;
+		if(poll(fds, 2, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			LogError("poll on uevent socket failed: %s\n", strerror(errno));
+			break;
+		}
+		if(fds[1].revents)
+			break;
+
+		auto len = recv(g_ueventSocket, buf, sizeof(buf) - 1, 0);
+		if(len < 0)
+		{
+			//ENOBUFS just means we missed some events while busy attaching
+			if( (errno == EINTR) || (errno == ENOBUFS) )
+				continue;
+			LogError("failed to read uevent: %s\n", strerror(errno));
+			break;
+		}
+		buf[len] = '\0';
+		OnUevent(buf, len);
+	}
+}
+
+/**
+	@brief Handles one uevent: "action@devpath" followed by NUL separated KEY=value pairs
+ */
+static void OnUevent(const char* buf, size_t len)
+{
+	string action;
+	string subsystem;
+	string devname;
+	for(size_t i = strlen(buf) + 1; i < len; i += strlen(buf + i) + 1)
+	{
+		const char* field = buf + i;
+		if(!strncmp(field, "ACTION=", 7))
+			action = field + 7;
+		else if(!strncmp(field, "SUBSYSTEM=", 10))
+			subsystem = field + 10;
+		else if(!strncmp(field, "DEVNAME=", 8))
+			devname = field + 8;
+	}
+
+	if(subsystem != "hidraw")
+		return;
+
+	LogDebug("uevent: %s %s\n", action.c_str(), devname.c_str());
+	if(action == "add")
+		OnDeviceArrived();
+	else if(action == "remove")
+		OnDeviceRemoved();
+}
+
+#else
+
+bool StartHotplugMonitor()
+{
+	LogError("hotplug detection is only supported on Linux\n");
+	return false;
+}
+
+void StopHotplugMonitor()
+{
+}
+
+bool IsHotplugMonitorRunning()
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,227 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of NonlinearityCorrection
+ */
+
+#include "specbridge.h"
+#include "NonlinearityCorrection.h"
+#include <math.h>
+#include <sstream>
+
+using namespace std;
+
+const size_t NonlinearityCorrection::TABLE_SIZE;
+
+//The currently active correction, shared with the data thread
+static shared_ptr<const NonlinearityCorrection> g_nonlinearity = make_shared<NonlinearityCorrection>();
+static mutex g_nonlinearityMutex;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an identity table (output equals raw counts)
+ */
+NonlinearityCorrection::NonlinearityCorrection()
+	: m_table(TABLE_SIZE)
+	, m_description("identity")
+{
+	for(size_t i=0; i<TABLE_SIZE; i++)
+		m_table[i] = i;
+}
+
+/**
+	@brief Creates a table from a polynomial mapping raw counts to corrected counts
+
+	corrected = coeffs[0] + coeffs[1]*raw + coeffs[2]*raw^2 + ...
+
+	@return The table, or null if no coefficients were given
+ */
+shared_ptr<NonlinearityCorrection> NonlinearityCorrection::FromPolynomial(const vector<double>& coeffs)
+{
+	if(coeffs.empty())
+	{
+		LogError("Nonlinearity polynomial needs at least one coefficient\n");
+		return nullptr;
+	}
+
+	auto ret = make_shared<NonlinearityCorrection>();
+	for(size_t i=0; i<TABLE_SIZE; i++)
+	{
+		//Horner's method, in double precision since raw^n gets big fast
+		double x = i;
+		double y = 0;
+		for(size_t j=coeffs.size(); j>0; j--)
+			y = y*x + coeffs[j-1];
+		ret->m_table[i] = y;
+	}
+
+	ret->m_description = "poly";
+	char tmp[64];
+	for(auto c : coeffs)
+	{
+		snprintf(tmp, sizeof(tmp), ",%g", c);
+		ret->m_description += tmp;
+	}
+
+	return ret;
+}
+
+/**
+	@brief Creates a table by piecewise linear interpolation between (raw, corrected) points
+
+	Codes outside the range of the table are extrapolated from the first or last segment.
+
+	@return The table, or null if the points were invalid
+ */
+shared_ptr<NonlinearityCorrection> NonlinearityCorrection::FromTable(
+	const vector<double>& raw,
+	const vector<double>& corrected)
+{
+	if( (raw.size() < 2) || (raw.size() != corrected.size()) )
+	{
+		LogError("Nonlinearity table needs at least two (raw, corrected) points\n");
+		return nullptr;
+	}
+	for(size_t i=1; i<raw.size(); i++)
+	{
+		if(raw[i] <= raw[i-1])
+		{
+			LogError("Nonlinearity table raw values must be strictly increasing\n");
+			return nullptr;
+		}
+	}
+
+	auto ret = make_shared<NonlinearityCorrection>();
+	size_t seg = 0;
+	size_t last = raw.size() - 2;
+	for(size_t i=0; i<TABLE_SIZE; i++)
+	{
+		double x = i;
+		while( (seg < last) && (x > raw[seg+1]) )
+			seg ++;
+
+		double frac = (x - raw[seg]) / (raw[seg+1] - raw[seg]);
+		ret->m_table[i] = corrected[seg] + frac*(corrected[seg+1] - corrected[seg]);
+	}
+
+	ret->m_description = "table," + to_string(raw.size());
+	return ret;
+}
+
+/**
+	@brief Loads a correction from a text file
+
+	The first token is either "poly", followed by the coefficients in increasing order of power, or "table", followed
+	by (raw, corrected) pairs. Tokens may be separated by any whitespace or commas.
+
+	@return The table, or null if the file could not be loaded
+ */
+shared_ptr<NonlinearityCorrection> NonlinearityCorrection::FromFile(const string& path)
+{
+	FILE* fp = fopen(path.c_str(), "r");
+	if(!fp)
+	{
+		LogError("Failed to open nonlinearity file %s\n", path.c_str());
+		return nullptr;
+	}
+
+	//Slurp the file and treat commas the same as whitespace
+	string text;
+	int c;
+	while(EOF != (c = fgetc(fp)))
+		text += (c == ',') ? ' ' : (char)c;
+	fclose(fp);
+
+	istringstream stream(text);
+	string stype;
+	stream >> stype;
+	vector<double> values;
+	double v;
+	while(stream >> v)
+		values.push_back(v);
+
+	//Stopped before the end: something that isn't a number, don't load a truncated correction
+	if(!stream.eof())
+	{
+		stream.clear();
+		string bad;
+		stream >> bad;
+		LogError("Nonlinearity file %s has an invalid value \"%s\"\n", path.c_str(), bad.c_str());
+		return nullptr;
+	}
+
+	if(stype == "poly")
+		return FromPolynomial(values);
+	else if(stype == "table")
+	{
+		if(values.size() % 2)
+		{
+			LogError("Nonlinearity table in %s has an odd number of values\n", path.c_str());
+			return nullptr;
+		}
+
+		vector<double> raw;
+		vector<double> corrected;
+		for(size_t i=0; i+1<values.size(); i+=2)
+		{
+			raw.push_back(values[i]);
+			corrected.push_back(values[i+1]);
+		}
+		return FromTable(raw, corrected);
+	}
+
+	LogError("Nonlinearity file %s must start with \"poly\" or \"table\"\n", path.c_str());
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Global state
+
+/**
+	@brief Gets the currently active correction table
+ */
+shared_ptr<const NonlinearityCorrection> GetNonlinearityCorrection()
+{
+	lock_guard<mutex> lock(g_nonlinearityMutex);
+	return g_nonlinearity;
+}
+
+/**
+	@brief Replaces the active correction table. Takes effect starting with the next frame.
+ */
+void SetNonlinearityCorrection(shared_ptr<const NonlinearityCorrection> correction)
+{
+	lock_guard<mutex> lock(g_nonlinearityMutex);
+	g_nonlinearity = correction;
+}
@@ -0,0 +1,82 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of NonlinearityCorrection
+ */
+
+#ifndef NonlinearityCorrection_h
+#define NonlinearityCorrection_h
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+	@brief Detector nonlinearity correction, baked into a lookup table covering every possible raw ADC code
+
+	The CCD response gets increasingly nonlinear as pixels approach full well. Rather than evaluating a correction
+	function per pixel, we precompute the corrected value for all 65536 raw codes once so the per-frame cost is a
+	single table lookup per pixel.
+
+	Objects are immutable once constructed so a table can be shared with the data thread without locking.
+ */
+class NonlinearityCorrection
+{
+public:
+	NonlinearityCorrection();
+
+	static std::shared_ptr<NonlinearityCorrection> FromPolynomial(const std::vector<double>& coeffs);
+	static std::shared_ptr<NonlinearityCorrection> FromTable(
+		const std::vector<double>& raw,
+		const std::vector<double>& corrected);
+	static std::shared_ptr<NonlinearityCorrection> FromFile(const std::string& path);
+
+	///@brief Number of entries in the lookup table (one per possible raw ADC code)
+	static const size_t TABLE_SIZE = 65536;
+
+	///@brief Gets the lookup table, indexed by raw ADC code
+	const float* GetTable() const
+	{ return &m_table[0]; }
+
+	///@brief Human readable description of where the table came from
+	const std::string& GetDescription() const
+	{ return m_description; }
+
+protected:
+	std::vector<float> m_table;
+	std::string m_description;
+};
+
+std::shared_ptr<const NonlinearityCorrection> GetNonlinearityCorrection();
+void SetNonlinearityCorrection(std::shared_ptr<const NonlinearityCorrection> correction);
+
+#endif
@@ -0,0 +1,607 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ProcessingPipeline
+ */
+
+#include "specbridge.h"
+#include "Calibration.h"
+#include "FastMath.h"
+#include "ProcessingPipeline.h"
+#include "Frame.h"
+#include "NonlinearityCorrection.h"
+#include <math.h>
+
+using namespace std;
+
+volatile bool g_darkCaptureRequested = false;
+
+//Current configuration and the pipeline compiled from it
+static mutex g_pipelineMutex;
+static vector<StageConfig> g_pipelineConfig = GetDefaultPipelineConfig();
+static shared_ptr<const ProcessingPipeline> g_pipeline;
+
+//True if g_pipeline is the default because g_pipelineConfig can't run right now
+static bool g_pipelineFallback = false;
+
+//Bitmask of enabled channels, and pipelines for the fixed channels (null if disabled or unavailable).
+//C1 is always g_pipeline so its slot here is unused.
+static uint32_t g_enabledChannels = 1 << CHANNEL_PIPELINE;
+static shared_ptr<const ProcessingPipeline> g_channelPipelines[CHANNEL_COUNT];
+
+//Data plane encoding of each channel
+static Quantizer g_channelQuantizers[CHANNEL_COUNT];
+
+//Dark reference frame
+static shared_ptr<const vector<float> > g_darkFrame;
+
+//Boxcar width for the smoothed channel
+static const char* CHANNEL_SMOOTH_WIDTH = "5";
+
+static ProcessingContext GetProcessingContext();
+static void RebuildChannel(size_t channel, const ProcessingContext& ctx);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+ProcessingPipeline::ProcessingPipeline()
+	: m_numPixels(0)
+	, m_heavy(false)
+	, m_table(nullptr)
+{
+}
+
+/**
+	@brief Creates stages from a configuration and compiles them into a pipeline
+
+	@return The pipeline, or null if any stage was invalid or could not be prepared
+ */
+shared_ptr<ProcessingPipeline> ProcessingPipeline::Compile(
+	const vector<StageConfig>& config,
+	const ProcessingContext& ctx)
+{
+	shared_ptr<ProcessingPipeline> ret(new ProcessingPipeline);
+	ret->m_numPixels = ctx.m_numPixels;
+
+	//Start out in sensor pixel space, labeled by wavelength if we have it
+	if(ctx.m_wavelengths)
+		ret->m_wavelengths.assign(ctx.m_wavelengths, ctx.m_wavelengths + ctx.m_numPixels);
+	else
+	{
+		ret->m_wavelengths.resize(ctx.m_numPixels);
+		for(size_t i=0; i<ctx.m_numPixels; i++)
+			ret->m_wavelengths[i] = i;
+	}
+
+	bool nativeMapping = true;
+	vector<float> scale;
+	vector<float> bias;
+	vector<float> wavelengths;
+	for(size_t i=0; i<config.size(); i++)
+	{
+		auto stage = ProcessingStage::Create(config[i]);
+		if(!stage)
+			return nullptr;
+		if(!stage->Prepare(ctx, ret->m_wavelengths, wavelengths))
+			return nullptr;
+		ret->m_wavelengths.swap(wavelengths);
+
+		//Nonlinearity is applied to raw ADC codes, so it has to come before anything else touches the data
+		auto nl = dynamic_cast<NonlinearityStage*>(stage.get());
+		if(nl)
+		{
+			if(i != 0)
+			{
+				LogError("NONLIN must be the first processing stage\n");
+				return nullptr;
+			}
+			ret->m_table = nl->GetTable();
+		}
+
+		//Elementwise stage: fold into the current run
+		else if(stage->IsElementwise())
+		{
+			if(!nativeMapping)
+			{
+				LogError("%s must come before any stage that changes the pixel mapping\n",
+					stage->GetDescription().c_str());
+				return nullptr;
+			}
+
+			if(scale.empty())
+			{
+				scale.resize(ctx.m_numPixels, 1);
+				bias.resize(ctx.m_numPixels, 0);
+			}
+			stage->Fuse(scale, bias);
+		}
+
+		//Block stage: end the current run
+		else
+		{
+			ret->FlushRun(scale, bias);
+
+			Step step;
+			step.m_block = stage.get();
+			ret->m_steps.push_back(step);
+
+			nativeMapping &= stage->PreservesPixelMapping();
+			ret->m_heavy |= stage->IsHeavy();
+		}
+
+		ret->m_stages.push_back(move(stage));
+	}
+	ret->FlushRun(scale, bias);
+
+	return ret;
+}
+
+/**
+	@brief Ends a run of elementwise stages, fusing it with the conversion pass if nothing came before it
+ */
+void ProcessingPipeline::FlushRun(vector<float>& scale, vector<float>& bias)
+{
+	if(scale.empty())
+		return;
+
+	if(m_steps.empty())
+	{
+		m_loadScale.swap(scale);
+		m_loadBias.swap(bias);
+	}
+	else
+	{
+		Step step;
+		step.m_block = nullptr;
+		step.m_scale.swap(scale);
+		step.m_bias.swap(bias);
+		m_steps.push_back(step);
+	}
+
+	scale.clear();
+	bias.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Processing
+
+/**
+	@brief Processes a single frame
+
+	@param raw		Raw pixel values, starting at the first valid pixel
+	@param out		Processed output
+	@param scratch	Working buffer, reused across calls to avoid reallocating
+	@param bands	If not null, filled with the mean of each of bands->size() equal slices of the frame as it comes
+					out of the conversion pass (for change detection)
+ */
+void ProcessingPipeline::Process(
+	const uint16_t* raw,
+	vector<float>& out,
+	vector<float>& scratch,
+	vector<float>* bands) const
+{
+	size_t len = m_numPixels;
+	out.resize(len);
+	float* pout = &out[0];
+
+	//Conversion pass, with nonlinearity and the first run of elementwise stages if we have them.
+	//Band means are taken a band at a time, while the band is still in cache from being converted.
+	if(!bands || bands->empty())
+		Convert(raw, pout, 0, len);
+	else
+	{
+		size_t nbands = bands->size();
+		for(size_t b=0; b<nbands; b++)
+		{
+			size_t start = len*b / nbands;
+			size_t end = len*(b+1) / nbands;
+			Convert(raw, pout, start, end);
+
+			float sum = 0;
+			for(size_t i=start; i<end; i++)
+				sum += pout[i];
+			(*bands)[b] = (end > start) ? sum / (end - start) : 0;
+		}
+	}
+
+	//Everything else
+	for(auto& step : m_steps)
+	{
+		if(step.m_block)
+		{
+			step.m_block->Process(out, scratch);
+			out.swap(scratch);
+		}
+		else
+		{
+			pout = &out[0];
+			len = out.size();
+			const float* scale = &step.m_scale[0];
+			const float* bias = &step.m_bias[0];
+			for(size_t i=0; i<len; i++)
+				pout[i] = pout[i]*scale[i] + bias[i];
+		}
+	}
+}
+
+/**
+	@brief Converts raw pixels [start, end) to float, applying nonlinearity and the fused load stages if we have them
+ */
+void ProcessingPipeline::Convert(const uint16_t* raw, float* pout, size_t start, size_t end) const
+{
+	const float* table = m_table;
+	if(m_loadScale.empty())
+	{
+		if(table)
+		{
+			for(size_t i=start; i<end; i++)
+				pout[i] = table[raw[i]];
+		}
+		else
+		{
+			for(size_t i=start; i<end; i++)
+				pout[i] = raw[i];
+		}
+	}
+	else
+	{
+		const float* scale = &m_loadScale[0];
+		const float* bias = &m_loadBias[0];
+		if(table)
+		{
+			for(size_t i=start; i<end; i++)
+				pout[i] = table[raw[i]]*scale[i] + bias[i];
+		}
+		else
+		{
+			for(size_t i=start; i<end; i++)
+				pout[i] = raw[i]*scale[i] + bias[i];
+		}
+	}
+}
+
+/**
+	@brief Returns the stages of the pipeline, separated by semicolons
+ */
+string ProcessingPipeline::GetDescription() const
+{
+	string ret;
+	for(auto& stage : m_stages)
+	{
+		if(!ret.empty())
+			ret += ";";
+		ret += stage->GetDescription();
+	}
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Global state
+
+static ProcessingContext GetProcessingContext()
+{
+	ProcessingContext ctx;
+	ctx.m_numPixels = g_numPixels;
+	ctx.m_exposure = g_exposure * 1e-5f;
+	ctx.m_nonlinearity = GetNonlinearityCorrection();
+	ctx.m_darkFrame = g_darkFrame;
+
+	ctx.m_calibration = TryGetCalibration();
+	if(ctx.m_calibration)
+	{
+		ctx.m_wavelengths = ctx.m_calibration->GetWavelengths();
+		ctx.m_sensorResponse = ctx.m_calibration->GetSensorResponse();
+		ctx.m_absResponse = ctx.m_calibration->GetAbsResponse();
+		ctx.m_absCal = ctx.m_calibration->m_absCal;
+	}
+	else
+	{
+		ctx.m_wavelengths = nullptr;
+		ctx.m_sensorResponse = nullptr;
+		ctx.m_absResponse = nullptr;
+		ctx.m_absCal = 1;
+	}
+	return ctx;
+}
+
+/**
+	@brief Gets the current pipeline. Only valid after the first call to RebuildPipeline().
+ */
+shared_ptr<const ProcessingPipeline> GetPipeline()
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	return g_pipeline;
+}
+
+vector<StageConfig> GetPipelineConfig()
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	return g_pipelineConfig;
+}
+
+/**
+	@brief The pipeline we start out with: nonlinearity-corrected counts
+ */
+vector<StageConfig> GetDefaultPipelineConfig()
+{
+	vector<StageConfig> ret;
+	ret.push_back(StageConfig(1, "NONLIN"));
+	return ret;
+}
+
+/**
+	@brief Replaces the pipeline configuration
+
+	@return False, leaving the current pipeline in place, if the new configuration does not compile
+ */
+bool SetPipelineConfig(const vector<StageConfig>& config)
+{
+	//Stages may need calibration, give it a chance to finish loading
+	GetCalibration();
+
+	lock_guard<mutex> lock(g_pipelineMutex);
+	auto pipeline = ProcessingPipeline::Compile(config, GetProcessingContext());
+	if(!pipeline)
+		return false;
+
+	g_pipelineConfig = config;
+	g_pipeline = pipeline;
+	g_pipelineFallback = false;
+	LogVerbose("Processing pipeline is now: %s\n", pipeline->GetDescription().c_str());
+	return true;
+}
+
+/**
+	@brief Recompiles the current configuration, picking up any changes to instrument state
+ */
+void RebuildPipeline()
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	auto ctx = GetProcessingContext();
+	for(size_t i=CHANNEL_PIPELINE+1; i<CHANNEL_COUNT; i++)
+		RebuildChannel(i, ctx);
+
+	auto pipeline = ProcessingPipeline::Compile(g_pipelineConfig, ctx);
+	if(pipeline)
+	{
+		if(g_pipelineFallback)
+			LogNotice("Processing pipeline can run again: %s\n", pipeline->GetDescription().c_str());
+		g_pipeline = pipeline;
+		g_pipelineFallback = false;
+		return;
+	}
+
+	//Calibration hasn't loaded yet, or the configuration can't run with the current instrument state (e.g. exposure
+	//set to zero). Run the default pipeline for now but keep the configuration: this gets called again whenever that
+	//state changes, and picks the configuration back up as soon as it compiles.
+	if(!TryGetCalibration())
+		LogVerbose("Calibration not loaded yet, using default processing pipeline until it is\n");
+	else if(!g_pipelineFallback)
+		LogWarning("Processing pipeline can't run with the current settings, using the default until it can\n");
+	g_pipeline = ProcessingPipeline::Compile(GetDefaultPipelineConfig(), ctx);
+	g_pipelineFallback = true;
+}
+
+/**
+	@brief True if the default pipeline is running in place of the configured one, because it can't run right now
+ */
+bool IsPipelineFallback()
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	return g_pipelineFallback;
+}
+
+/**
+	@brief Sets the dark reference frame, in nonlinearity-corrected counts, and recompiles the pipeline
+ */
+void SetDarkFrame(shared_ptr<const vector<float> > dark)
+{
+	{
+		lock_guard<mutex> lock(g_pipelineMutex);
+		g_darkFrame = dark;
+	}
+	RebuildPipeline();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Channels
+
+/**
+	@brief Returns the short name of a channel, as reported by CHANNELS?
+ */
+const char* GetChannelName(size_t channel)
+{
+	switch(channel)
+	{
+		case CHANNEL_PIPELINE:		return "PIPE";
+		case CHANNEL_RAW:			return "RAW";
+		case CHANNEL_DARK:			return "DARK";
+		case CHANNEL_FLAT:			return "FLAT";
+		case CHANNEL_IRRADIANCE:	return "IRR";
+		case CHANNEL_SMOOTHED:		return "SMOOTH";
+		default:					return "";
+	}
+}
+
+/**
+	@brief Returns the stages that make up one of the fixed channels
+ */
+static vector<StageConfig> GetChannelConfig(size_t channel)
+{
+	vector<StageConfig> ret;
+	if(channel == CHANNEL_RAW)
+		return ret;
+
+	ret.push_back(StageConfig(1, "NONLIN"));
+	ret.push_back(StageConfig(1, "DARK"));
+	if(channel == CHANNEL_DARK)
+		return ret;
+
+	ret.push_back(StageConfig(1, "FLAT"));
+	if(channel == CHANNEL_IRRADIANCE)
+		ret.push_back(StageConfig(1, "IRR"));
+	else if(channel == CHANNEL_SMOOTHED)
+		ret.push_back(StageConfig{ "SMOOTH", CHANNEL_SMOOTH_WIDTH });
+	return ret;
+}
+
+/**
+	@brief Compiles one of the fixed channels if it's enabled, or frees its pipeline if not
+
+	Must be called with g_pipelineMutex held.
+ */
+static void RebuildChannel(size_t channel, const ProcessingContext& ctx)
+{
+	auto& pipeline = g_channelPipelines[channel];
+	if(!(g_enabledChannels & (1 << channel)))
+	{
+		pipeline = nullptr;
+		return;
+	}
+
+	//Calibrated channels get compiled again once calibration has loaded, don't complain about it in the meantime
+	if(!ctx.m_calibration && (channel >= CHANNEL_FLAT))
+	{
+		pipeline = nullptr;
+		return;
+	}
+
+	pipeline = ProcessingPipeline::Compile(GetChannelConfig(channel), ctx);
+	if(!pipeline)
+		LogWarning("Channel C%zu (%s) is not available on this instrument\n", channel+1, GetChannelName(channel));
+}
+
+/**
+	@brief Turns a channel on or off on the data plane
+ */
+void EnableChannel(size_t channel, bool enabled)
+{
+	if(channel >= CHANNEL_COUNT)
+		return;
+
+	lock_guard<mutex> lock(g_pipelineMutex);
+	uint32_t mask = 1 << channel;
+	if(enabled == ((g_enabledChannels & mask) != 0))
+		return;
+
+	if(enabled)
+		g_enabledChannels |= mask;
+	else
+		g_enabledChannels &= ~mask;
+
+	if(channel != CHANNEL_PIPELINE)
+		RebuildChannel(channel, GetProcessingContext());
+}
+
+/**
+	@brief Returns a bitmask of the enabled channels (bit 0 is C1)
+ */
+uint32_t GetEnabledChannels()
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	return g_enabledChannels;
+}
+
+/**
+	@brief Fills in one entry per channel to compute for the next frame, in channel order
+
+	Channels that are enabled but can't currently be computed (e.g. missing calibration) are left out.
+ */
+void GetChannelPipelines(vector<FrameChannel>& channels)
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	channels.clear();
+	for(size_t i=0; i<CHANNEL_COUNT; i++)
+	{
+		if(!(g_enabledChannels & (1 << i)))
+			continue;
+
+		auto& pipeline = (i == CHANNEL_PIPELINE) ? g_pipeline : g_channelPipelines[i];
+		if(!pipeline)
+			continue;
+
+		channels.push_back(FrameChannel());
+		channels.back().m_index = i;
+		channels.back().m_pipeline = pipeline;
+		channels.back().m_quantizer = g_channelQuantizers[i];
+	}
+}
+
+/**
+	@brief Sets how a channel's samples are encoded on the data plane
+ */
+bool SetChannelFormat(size_t channel, SampleFormat format)
+{
+	if(channel >= CHANNEL_COUNT)
+		return false;
+
+	lock_guard<mutex> lock(g_pipelineMutex);
+	auto& q = g_channelQuantizers[channel];
+	q = Quantizer(format, q.GetRange(), q.GetWindowOffset());
+	return true;
+}
+
+/**
+	@brief Sets the width of the window a quantized channel's codes are spread over
+
+	@return False if the range isn't positive
+ */
+bool SetChannelRange(size_t channel, double range)
+{
+	if( (channel >= CHANNEL_COUNT) || !(range > 0) || !IsFiniteValue(range) )
+		return false;
+
+	lock_guard<mutex> lock(g_pipelineMutex);
+	auto& q = g_channelQuantizers[channel];
+	q = Quantizer(q.GetFormat(), range, q.GetWindowOffset());
+	return true;
+}
+
+/**
+	@brief Sets the offset of a quantized channel's window (the window is centered on -offset)
+ */
+bool SetChannelOffset(size_t channel, double offset)
+{
+	if( (channel >= CHANNEL_COUNT) || !IsFiniteValue(offset) )
+		return false;
+
+	lock_guard<mutex> lock(g_pipelineMutex);
+	auto& q = g_channelQuantizers[channel];
+	q = Quantizer(q.GetFormat(), q.GetRange(), offset);
+	return true;
+}
+
+Quantizer GetChannelQuantizer(size_t channel)
+{
+	lock_guard<mutex> lock(g_pipelineMutex);
+	return g_channelQuantizers[channel];
+}
@@ -0,0 +1,167 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ProcessingPipeline
+ */
+
+#ifndef ProcessingPipeline_h
+#define ProcessingPipeline_h
+
+#include "ProcessingStage.h"
+#include "Quantizer.h"
+#include <stdint.h>
+
+///@brief A stage name followed by its parameters, as given to PIPE:ADD
+typedef std::vector<std::string> StageConfig;
+
+/**
+	@brief A compiled, immutable chain of processing stages applied to each frame
+
+	Compilation folds each run of adjacent elementwise stages into a single per-pixel (scale, bias) pair. A run at the
+	start of the pipeline is additionally fused with the raw-to-float conversion (and nonlinearity table lookup), so
+	the common calibration chain of NONLIN, DARK, FLAT, IRR is a single pass over the frame.
+
+	Any change to the configuration or to instrument state the stages depend on (exposure, dark frame, calibration,
+	nonlinearity table) produces a new pipeline object rather than modifying the existing one, so the data thread can
+	keep using whatever pipeline it grabbed at the start of a frame without locking.
+ */
+class ProcessingPipeline
+{
+public:
+	static std::shared_ptr<ProcessingPipeline> Compile(
+		const std::vector<StageConfig>& config,
+		const ProcessingContext& ctx);
+
+	void Process(
+		const uint16_t* raw,
+		std::vector<float>& out,
+		std::vector<float>& scratch,
+		std::vector<float>* bands = nullptr) const;
+
+	///@brief Number of points in each processed frame
+	size_t GetOutputLength() const
+	{ return m_wavelengths.size(); }
+
+	///@brief Wavelength of each point in a processed frame (pixel index if the sensor is not calibrated)
+	const std::vector<float>& GetWavelengths() const
+	{ return m_wavelengths; }
+
+	std::string GetDescription() const;
+
+	///@brief True if any stage is expensive enough to be worth running on the worker pool
+	bool IsHeavy() const
+	{ return m_heavy; }
+
+protected:
+	ProcessingPipeline();
+
+	void FlushRun(std::vector<float>& scale, std::vector<float>& bias);
+	void Convert(const uint16_t* raw, float* pout, size_t start, size_t end) const;
+
+	///@brief Either a fused run of elementwise stages, or a single block stage
+	class Step
+	{
+	public:
+		std::vector<float> m_scale;
+		std::vector<float> m_bias;
+		const ProcessingStage* m_block;
+	};
+
+	size_t m_numPixels;
+
+	bool m_heavy;
+
+	///@brief Nonlinearity table to apply during conversion, or null for none
+	const float* m_table;
+
+	///@brief Elementwise stages fused into the conversion pass (empty if none)
+	std::vector<float> m_loadScale;
+	std::vector<float> m_loadBias;
+
+	std::vector<Step> m_steps;
+
+	std::vector<std::unique_ptr<ProcessingStage> > m_stages;
+
+	std::vector<float> m_wavelengths;
+};
+
+std::shared_ptr<const ProcessingPipeline> GetPipeline();
+std::vector<StageConfig> GetPipelineConfig();
+bool SetPipelineConfig(const std::vector<StageConfig>& config);
+std::vector<StageConfig> GetDefaultPipelineConfig();
+void RebuildPipeline();
+bool IsPipelineFallback();
+
+/**
+	@brief Logical channels on the data plane
+
+	C1 carries the output of the configurable pipeline (PIPE:*). The others are fixed points along the calibration
+	chain, each compiled and computed only while it's enabled, so nobody pays for a conversion they don't look at.
+ */
+enum ChannelIndex
+{
+	///@brief C1: configurable pipeline
+	CHANNEL_PIPELINE,
+
+	///@brief C2: raw counts
+	CHANNEL_RAW,
+
+	///@brief C3: nonlinearity corrected, dark subtracted
+	CHANNEL_DARK,
+
+	///@brief C4: as C3, divided by flatness calibration
+	CHANNEL_FLAT,
+
+	///@brief C5: as C4, converted to absolute irradiance
+	CHANNEL_IRRADIANCE,
+
+	///@brief C6: as C4, smoothed
+	CHANNEL_SMOOTHED,
+
+	CHANNEL_COUNT
+};
+
+class FrameChannel;
+
+const char* GetChannelName(size_t channel);
+void EnableChannel(size_t channel, bool enabled);
+uint32_t GetEnabledChannels();
+bool SetChannelFormat(size_t channel, SampleFormat format);
+bool SetChannelRange(size_t channel, double range);
+bool SetChannelOffset(size_t channel, double offset);
+Quantizer GetChannelQuantizer(size_t channel);
+void GetChannelPipelines(std::vector<FrameChannel>& channels);
+
+void SetDarkFrame(std::shared_ptr<const std::vector<float> > dark);
+extern volatile bool g_darkCaptureRequested;
+
+#endif
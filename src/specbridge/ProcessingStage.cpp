@@ -0,0 +1,565 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ProcessingStage and the built-in stage types
+ */
+
+#include "specbridge.h"
+#include "ProcessingStage.h"
+#include "NonlinearityCorrection.h"
+#include <math.h>
+
+using namespace std;
+
+static bool ParseStageArgs(const vector<string>& args, size_t count, vector<float>& out);
+static string FormatStageArgs(const char* name, const vector<float>& values);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+/**
+	@brief Parses the numeric arguments (everything after the stage name) of a PIPE:ADD command
+
+	@param args		The arguments, including the stage name
+	@param count	Expected number of numeric arguments. Zero means "one or more pairs".
+	@param out		The parsed values
+ */
+static bool ParseStageArgs(const vector<string>& args, size_t count, vector<float>& out)
+{
+	out.clear();
+	for(size_t i=1; i<args.size(); i++)
+	{
+		char* end = nullptr;
+		float v = strtof(args[i].c_str(), &end);
+		if( (end == args[i].c_str()) || (*end != '\0') )
+		{
+			LogError("Invalid argument \"%s\" to %s stage\n", args[i].c_str(), args[0].c_str());
+			return false;
+		}
+		out.push_back(v);
+	}
+
+	if(count == 0)
+	{
+		if(out.empty() || (out.size() % 2) )
+		{
+			LogError("%s stage needs one or more pairs of arguments\n", args[0].c_str());
+			return false;
+		}
+	}
+	else if(out.size() != count)
+	{
+		LogError("%s stage needs %zu argument(s)\n", args[0].c_str(), count);
+		return false;
+	}
+	return true;
+}
+
+static string FormatStageArgs(const char* name, const vector<float>& values)
+{
+	string ret = name;
+	char tmp[32];
+	for(auto v : values)
+	{
+		snprintf(tmp, sizeof(tmp), ",%g", v);
+		ret += tmp;
+	}
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ProcessingStage
+
+ProcessingStage::~ProcessingStage()
+{
+}
+
+/**
+	@brief Creates a stage from the arguments of a PIPE:ADD command (stage name followed by its parameters)
+
+	@return The new stage, or null if the arguments were invalid
+ */
+unique_ptr<ProcessingStage> ProcessingStage::Create(const vector<string>& args)
+{
+	if(args.empty())
+	{
+		LogError("No stage name specified\n");
+		return nullptr;
+	}
+
+	auto& name = args[0];
+	vector<float> values;
+	if(name == "NONLIN")
+	{
+		if(args.size() == 1)
+			return unique_ptr<ProcessingStage>(new NonlinearityStage);
+	}
+	else if(name == "DARK")
+	{
+		if(args.size() == 1)
+			return unique_ptr<ProcessingStage>(new DarkSubtractStage);
+	}
+	else if(name == "FLAT")
+	{
+		if(args.size() == 1)
+			return unique_ptr<ProcessingStage>(new FlatFieldStage);
+	}
+	else if(name == "IRR")
+	{
+		if(args.size() == 1)
+			return unique_ptr<ProcessingStage>(new IrradianceStage);
+	}
+	else if(name == "SMOOTH")
+	{
+		if(ParseStageArgs(args, 1, values))
+		{
+			if( (values[0] < 1) || (fmodf(values[0], 2) != 1) )
+				LogError("SMOOTH width must be a positive odd integer\n");
+			else
+				return unique_ptr<ProcessingStage>(new SmoothStage(values[0]));
+		}
+		return nullptr;
+	}
+	else if(name == "RESAMPLE")
+	{
+		if(ParseStageArgs(args, 3, values))
+		{
+			if( (values[2] <= 0) || (values[1] <= values[0]) )
+				LogError("RESAMPLE needs start < stop and a positive step\n");
+			else if( (values[1] - values[0]) / values[2] > 1e6)
+				LogError("RESAMPLE grid is too large\n");
+			else
+				return unique_ptr<ProcessingStage>(new ResampleStage(values[0], values[1], values[2]));
+		}
+		return nullptr;
+	}
+	else if(name == "BIN")
+	{
+		if(ParseStageArgs(args, 1, values))
+		{
+			if( (values[0] < 1) || (values[0] != floorf(values[0])) )
+				LogError("BIN width must be a positive integer\n");
+			else
+				return unique_ptr<ProcessingStage>(new BinStage(values[0]));
+		}
+		return nullptr;
+	}
+	else if(name == "REDUCE")
+	{
+		if(ParseStageArgs(args, 0, values))
+			return unique_ptr<ProcessingStage>(new ReduceStage(values));
+		return nullptr;
+	}
+	else
+	{
+		LogError("Unknown processing stage %s\n", name.c_str());
+		return nullptr;
+	}
+
+	LogError("%s stage takes no arguments\n", name.c_str());
+	return nullptr;
+}
+
+/**
+	@brief Prepares the stage for processing frames
+
+	Called once each time the pipeline is compiled, so this is the place for any precomputation.
+
+	@param ctx					Instrument state
+	@param inputWavelengths		Wavelength of each point in the input to this stage
+	@param outputWavelengths	Wavelength of each point in the output of this stage
+
+	@return False if the stage cannot run (e.g. due to missing calibration)
+ */
+bool ProcessingStage::Prepare(
+	const ProcessingContext& /*ctx*/,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	outputWavelengths = inputWavelengths;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// NonlinearityStage
+
+string NonlinearityStage::GetDescription() const
+{
+	return "NONLIN";
+}
+
+bool NonlinearityStage::Prepare(
+	const ProcessingContext& ctx,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	m_nonlinearity = ctx.m_nonlinearity;
+	outputWavelengths = inputWavelengths;
+	return true;
+}
+
+const float* NonlinearityStage::GetTable() const
+{
+	return m_nonlinearity->GetTable();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DarkSubtractStage
+
+string DarkSubtractStage::GetDescription() const
+{
+	return "DARK";
+}
+
+bool DarkSubtractStage::Prepare(
+	const ProcessingContext& ctx,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	m_darkFrame = ctx.m_darkFrame;
+	if(!m_darkFrame)
+		LogWarning("No dark frame captured yet, DARK stage will have no effect until DARK:CAPTURE\n");
+	else if(m_darkFrame->size() != ctx.m_numPixels)
+	{
+		LogError("Dark frame size does not match sensor\n");
+		return false;
+	}
+
+	outputWavelengths = inputWavelengths;
+	return true;
+}
+
+void DarkSubtractStage::Fuse(vector<float>& /*scale*/, vector<float>& bias) const
+{
+	if(!m_darkFrame)
+		return;
+
+	auto& dark = *m_darkFrame;
+	for(size_t i=0; i<bias.size(); i++)
+		bias[i] -= dark[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FlatFieldStage
+
+string FlatFieldStage::GetDescription() const
+{
+	return "FLAT";
+}
+
+bool FlatFieldStage::Prepare(
+	const ProcessingContext& ctx,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	if(!ctx.m_sensorResponse)
+	{
+		LogError("FLAT stage requires flatness calibration\n");
+		return false;
+	}
+
+	//Precompute reciprocals so the fused pass only has to multiply.
+	//Non-positive coefficients are dead pixels, zero them rather than blowing up.
+	auto response = ctx.m_sensorResponse;
+	m_gain.resize(ctx.m_numPixels);
+	for(size_t i=0; i<ctx.m_numPixels; i++)
+		m_gain[i] = (response[i] > 0) ? 1.0f / response[i] : 0;
+
+	outputWavelengths = inputWavelengths;
+	return true;
+}
+
+void FlatFieldStage::Fuse(vector<float>& scale, vector<float>& bias) const
+{
+	for(size_t i=0; i<scale.size(); i++)
+	{
+		scale[i] *= m_gain[i];
+		bias[i] *= m_gain[i];
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// IrradianceStage
+
+string IrradianceStage::GetDescription() const
+{
+	return "IRR";
+}
+
+bool IrradianceStage::Prepare(
+	const ProcessingContext& ctx,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	if(!ctx.m_absResponse)
+	{
+		LogError("IRR stage requires irradiance calibration\n");
+		return false;
+	}
+	if(ctx.m_exposure <= 0)
+	{
+		LogError("IRR stage requires a nonzero exposure time\n");
+		return false;
+	}
+
+	auto response = ctx.m_absResponse;
+	float k = ctx.m_absCal / ctx.m_exposure;
+	m_gain.resize(ctx.m_numPixels);
+	for(size_t i=0; i<ctx.m_numPixels; i++)
+		m_gain[i] = response[i] * k;
+
+	outputWavelengths = inputWavelengths;
+	return true;
+}
+
+void IrradianceStage::Fuse(vector<float>& scale, vector<float>& bias) const
+{
+	for(size_t i=0; i<scale.size(); i++)
+	{
+		scale[i] *= m_gain[i];
+		bias[i] *= m_gain[i];
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SmoothStage
+
+SmoothStage::SmoothStage(size_t width)
+	: m_width(width)
+{
+}
+
+string SmoothStage::GetDescription() const
+{
+	return "SMOOTH," + to_string(m_width);
+}
+
+void SmoothStage::Process(const vector<float>& in, vector<float>& out) const
+{
+	//Running sum, so cost is independent of window size.
+	//Window is truncated (and the average taken over fewer points) at the ends of the spectrum.
+	size_t len = in.size();
+	size_t half = m_width / 2;
+	out.resize(len);
+
+	double sum = 0;
+	size_t lo = 0;
+	size_t hi = 0;
+	for(size_t i=0; i<len; i++)
+	{
+		size_t wantLo = (i > half) ? i - half : 0;
+		size_t wantHi = min(len, i + half + 1);
+		for(; hi < wantHi; hi++)
+			sum += in[hi];
+		for(; lo < wantLo; lo++)
+			sum -= in[lo];
+		out[i] = sum / (hi - lo);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ResampleStage
+
+ResampleStage::ResampleStage(float start, float stop, float step)
+	: m_start(start)
+	, m_stop(stop)
+	, m_step(step)
+{
+}
+
+string ResampleStage::GetDescription() const
+{
+	return FormatStageArgs("RESAMPLE", { m_start, m_stop, m_step });
+}
+
+bool ResampleStage::Prepare(
+	const ProcessingContext& /*ctx*/,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	size_t len = inputWavelengths.size();
+	if(len < 2)
+	{
+		LogError("RESAMPLE stage requires wavelength calibration\n");
+		return false;
+	}
+
+	//Calibration may run either way across the sensor
+	bool ascending = inputWavelengths[len-1] > inputWavelengths[0];
+
+	size_t npoints = floor((m_stop - m_start) / m_step) + 1;
+	m_index.resize(npoints);
+	m_frac.resize(npoints);
+	outputWavelengths.resize(npoints);
+	for(size_t i=0; i<npoints; i++)
+	{
+		float target = m_start + i*m_step;
+		outputWavelengths[i] = target;
+
+		//Binary search for the segment containing the target
+		size_t lo = 0;
+		size_t hi = len - 1;
+		while(hi - lo > 1)
+		{
+			size_t mid = (lo + hi) / 2;
+			if( (inputWavelengths[mid] <= target) == ascending)
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		//Clamp to the edge value outside the calibrated range
+		float frac = (target - inputWavelengths[lo]) / (inputWavelengths[hi] - inputWavelengths[lo]);
+		m_index[i] = lo;
+		m_frac[i] = max(0.0f, min(1.0f, frac));
+	}
+
+	return true;
+}
+
+void ResampleStage::Process(const vector<float>& in, vector<float>& out) const
+{
+	size_t npoints = m_index.size();
+	out.resize(npoints);
+	for(size_t i=0; i<npoints; i++)
+	{
+		size_t j = m_index[i];
+		out[i] = in[j] + m_frac[i]*(in[j+1] - in[j]);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BinStage
+
+BinStage::BinStage(size_t width)
+	: m_width(width)
+{
+}
+
+string BinStage::GetDescription() const
+{
+	return "BIN," + to_string(m_width);
+}
+
+bool BinStage::Prepare(
+	const ProcessingContext& /*ctx*/,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	Process(inputWavelengths, outputWavelengths);
+	return true;
+}
+
+void BinStage::Process(const vector<float>& in, vector<float>& out) const
+{
+	//Trailing partial bin is averaged over however many points it has
+	size_t len = in.size();
+	out.resize( (len + m_width - 1) / m_width );
+	for(size_t i=0; i<out.size(); i++)
+	{
+		size_t first = i*m_width;
+		size_t last = min(len, first + m_width);
+		float sum = 0;
+		for(size_t j=first; j<last; j++)
+			sum += in[j];
+		out[i] = sum / (last - first);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ReduceStage
+
+ReduceStage::ReduceStage(const vector<float>& bands)
+	: m_bands(bands)
+{
+}
+
+string ReduceStage::GetDescription() const
+{
+	return FormatStageArgs("REDUCE", m_bands);
+}
+
+bool ReduceStage::Prepare(
+	const ProcessingContext& /*ctx*/,
+	const vector<float>& inputWavelengths,
+	vector<float>& outputWavelengths)
+{
+	if(inputWavelengths.empty())
+	{
+		LogError("REDUCE stage requires wavelength calibration\n");
+		return false;
+	}
+
+	//Wavelengths are monotonic, so the points within a band are always contiguous
+	size_t nbands = m_bands.size() / 2;
+	m_ranges.resize(nbands * 2);
+	outputWavelengths.resize(nbands);
+	for(size_t i=0; i<nbands; i++)
+	{
+		float lo = min(m_bands[i*2], m_bands[i*2 + 1]);
+		float hi = max(m_bands[i*2], m_bands[i*2 + 1]);
+		outputWavelengths[i] = (lo + hi) / 2;
+
+		size_t first = inputWavelengths.size();
+		size_t count = 0;
+		for(size_t j=0; j<inputWavelengths.size(); j++)
+		{
+			if( (inputWavelengths[j] >= lo) && (inputWavelengths[j] <= hi) )
+			{
+				first = min(first, j);
+				count ++;
+			}
+		}
+		if(count == 0)
+			LogWarning("REDUCE band %g-%g nm contains no points\n", lo, hi);
+
+		m_ranges[i*2] = first;
+		m_ranges[i*2 + 1] = count;
+	}
+
+	return true;
+}
+
+void ReduceStage::Process(const vector<float>& in, vector<float>& out) const
+{
+	size_t nbands = m_ranges.size() / 2;
+	out.resize(nbands);
+	for(size_t i=0; i<nbands; i++)
+	{
+		size_t first = m_ranges[i*2];
+		size_t count = m_ranges[i*2 + 1];
+		float sum = 0;
+		for(size_t j=0; j<count; j++)
+			sum += in[first + j];
+		out[i] = count ? sum / count : 0;
+	}
+}
@@ -0,0 +1,294 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ProcessingStage and the built-in stage types
+ */
+
+#ifndef ProcessingStage_h
+#define ProcessingStage_h
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Calibration;
+class NonlinearityCorrection;
+
+/**
+	@brief Everything a stage may need to know about the instrument when a pipeline is compiled
+ */
+class ProcessingContext
+{
+public:
+	///@brief Number of valid pixels in a raw frame
+	size_t m_numPixels;
+
+	///@brief Exposure time, in seconds
+	float m_exposure;
+
+	///@brief Active nonlinearity correction table
+	std::shared_ptr<const NonlinearityCorrection> m_nonlinearity;
+
+	///@brief Dark reference frame, in nonlinearity-corrected counts (null if not captured)
+	std::shared_ptr<const std::vector<float> > m_darkFrame;
+
+	///@brief Calibration the tables below point into (null if not loaded yet)
+	std::shared_ptr<const Calibration> m_calibration;
+
+	///@brief Calibration tables, m_numPixels entries each (null if not available)
+	const float* m_wavelengths;
+	const float* m_sensorResponse;
+	const float* m_absResponse;
+	float m_absCal;
+};
+
+/**
+	@brief A single step in the per-frame processing pipeline
+
+	Stages come in two flavors:
+	* Elementwise stages apply y[i] = x[i]*scale[i] + bias[i] to each pixel. Any run of adjacent elementwise stages is
+	  folded into a single (scale, bias) pair when the pipeline is compiled, so the whole run costs one pass over the
+	  frame no matter how many stages it contains.
+	* Block stages see the whole frame at once and may change its length (and the wavelength of each point).
+
+	A stage is created from the arguments of a PIPE:ADD command and then prepared once per pipeline compilation.
+	After that it is never modified, so Process() may be called from multiple threads at once.
+ */
+class ProcessingStage
+{
+public:
+	virtual ~ProcessingStage();
+
+	static std::unique_ptr<ProcessingStage> Create(const std::vector<std::string>& args);
+
+	///@brief Description of the stage and its parameters, in the same format as the PIPE:ADD arguments
+	virtual std::string GetDescription() const =0;
+
+	///@brief True if this stage is elementwise and can be fused with its neighbors
+	virtual bool IsElementwise() const
+	{ return false; }
+
+	///@brief True if this stage is expensive enough to be worth running on the worker pool
+	virtual bool IsHeavy() const
+	{ return false; }
+
+	///@brief True if output point i still corresponds to sensor pixel i
+	virtual bool PreservesPixelMapping() const
+	{ return true; }
+
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths);
+
+	/**
+		@brief Folds this (elementwise) stage into an existing per-pixel scale and bias
+	 */
+	virtual void Fuse(std::vector<float>& /*scale*/, std::vector<float>& /*bias*/) const
+	{}
+
+	/**
+		@brief Runs this (block) stage on a frame
+	 */
+	virtual void Process(const std::vector<float>& /*in*/, std::vector<float>& /*out*/) const
+	{}
+};
+
+/**
+	@brief Applies the detector nonlinearity correction. Only valid as the first stage since it operates on raw codes.
+ */
+class NonlinearityStage : public ProcessingStage
+{
+public:
+	virtual std::string GetDescription() const override;
+	virtual bool IsElementwise() const override
+	{ return true; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+
+	const float* GetTable() const;
+
+protected:
+	std::shared_ptr<const NonlinearityCorrection> m_nonlinearity;
+};
+
+/**
+	@brief Subtracts the captured dark frame
+ */
+class DarkSubtractStage : public ProcessingStage
+{
+public:
+	virtual std::string GetDescription() const override;
+	virtual bool IsElementwise() const override
+	{ return true; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+	virtual void Fuse(std::vector<float>& scale, std::vector<float>& bias) const override;
+
+protected:
+	std::shared_ptr<const std::vector<float> > m_darkFrame;
+};
+
+/**
+	@brief Divides by the sensor flatness calibration (block 2 of the cal file)
+ */
+class FlatFieldStage : public ProcessingStage
+{
+public:
+	virtual std::string GetDescription() const override;
+	virtual bool IsElementwise() const override
+	{ return true; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+	virtual void Fuse(std::vector<float>& scale, std::vector<float>& bias) const override;
+
+protected:
+	std::vector<float> m_gain;
+};
+
+/**
+	@brief Converts to absolute irradiance using the irradiance calibration (line 2 and block 3 of the cal file),
+	normalized to the current exposure time
+ */
+class IrradianceStage : public ProcessingStage
+{
+public:
+	virtual std::string GetDescription() const override;
+	virtual bool IsElementwise() const override
+	{ return true; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+	virtual void Fuse(std::vector<float>& scale, std::vector<float>& bias) const override;
+
+protected:
+	std::vector<float> m_gain;
+};
+
+/**
+	@brief Boxcar (moving average) smoothing
+ */
+class SmoothStage : public ProcessingStage
+{
+public:
+	SmoothStage(size_t width);
+
+	virtual std::string GetDescription() const override;
+	virtual void Process(const std::vector<float>& in, std::vector<float>& out) const override;
+
+protected:
+	size_t m_width;
+};
+
+/**
+	@brief Linear interpolation onto a uniform wavelength grid
+ */
+class ResampleStage : public ProcessingStage
+{
+public:
+	ResampleStage(float start, float stop, float step);
+
+	virtual std::string GetDescription() const override;
+	virtual bool IsHeavy() const override
+	{ return true; }
+	virtual bool PreservesPixelMapping() const override
+	{ return false; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+	virtual void Process(const std::vector<float>& in, std::vector<float>& out) const override;
+
+protected:
+	float m_start;
+	float m_stop;
+	float m_step;
+
+	//Precomputed interpolation: out[i] = in[m_index[i]]*(1-m_frac[i]) + in[m_index[i]+1]*m_frac[i]
+	std::vector<size_t> m_index;
+	std::vector<float> m_frac;
+};
+
+/**
+	@brief Averages groups of adjacent points
+ */
+class BinStage : public ProcessingStage
+{
+public:
+	BinStage(size_t width);
+
+	virtual std::string GetDescription() const override;
+	virtual bool PreservesPixelMapping() const override
+	{ return false; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+	virtual void Process(const std::vector<float>& in, std::vector<float>& out) const override;
+
+protected:
+	size_t m_width;
+};
+
+/**
+	@brief Reduces the spectrum to the mean value within each of a list of wavelength bands
+ */
+class ReduceStage : public ProcessingStage
+{
+public:
+	ReduceStage(const std::vector<float>& bands);
+
+	virtual std::string GetDescription() const override;
+	virtual bool PreservesPixelMapping() const override
+	{ return false; }
+	virtual bool Prepare(
+		const ProcessingContext& ctx,
+		const std::vector<float>& inputWavelengths,
+		std::vector<float>& outputWavelengths) override;
+	virtual void Process(const std::vector<float>& in, std::vector<float>& out) const override;
+
+protected:
+	///@brief Band edges, in nm, as (low, high) pairs
+	std::vector<float> m_bands;
+
+	///@brief Range of input points in each band, as (first, count) pairs
+	std::vector<size_t> m_ranges;
+};
+
+#endif
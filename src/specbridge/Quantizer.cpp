@@ -0,0 +1,254 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of Quantizer
+ */
+
+#include "specbridge.h"
+#include "Quantizer.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+bool ParseSampleFormat(const string& name, SampleFormat& format)
+{
+	if(name == "FLOAT32")
+		format = SAMPLE_FLOAT32;
+	else if(name == "INT16")
+		format = SAMPLE_INT16;
+	else if(name == "INT8")
+		format = SAMPLE_INT8;
+	else
+		return false;
+	return true;
+}
+
+const char* GetSampleFormatName(SampleFormat format)
+{
+	switch(format)
+	{
+		case SAMPLE_INT16:	return "INT16";
+		case SAMPLE_INT8:	return "INT8";
+		default:			return "FLOAT32";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a quantizer that passes float samples through, with a window covering the full range of raw counts
+ */
+Quantizer::Quantizer()
+	: Quantizer(SAMPLE_FLOAT32, 65535, -32767.5)
+{
+}
+
+Quantizer::Quantizer(SampleFormat format, double range, double offset)
+	: m_format(format)
+	, m_range(range)
+	, m_windowOffset(offset)
+	, m_scale(1)
+	, m_offset(0)
+	, m_gain(1)
+	, m_bias(0)
+	, m_minCode(0)
+	, m_maxCode(0)
+{
+	if(format == SAMPLE_INT16)
+	{
+		m_minCode = INT16_MIN;
+		m_maxCode = INT16_MAX;
+	}
+	else if(format == SAMPLE_INT8)
+	{
+		m_minCode = INT8_MIN;
+		m_maxCode = INT8_MAX;
+	}
+	else
+		return;
+
+	double lo = -offset - range/2;
+	double scale = range / (m_maxCode - m_minCode);
+	m_scale = scale;
+	m_offset = lo - m_minCode*scale;
+	m_gain = 1 / scale;
+	m_bias = m_minCode - lo/scale;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Conversion
+
+/**
+	@brief Number of bytes per encoded sample
+ */
+size_t Quantizer::GetSampleSize() const
+{
+	switch(m_format)
+	{
+		case SAMPLE_INT16:	return sizeof(int16_t);
+		case SAMPLE_INT8:	return sizeof(int8_t);
+		default:			return sizeof(float);
+	}
+}
+
+/**
+	@brief Encodes a block of samples
+
+	@param in	Processed samples
+	@param len	Number of samples
+	@param out	Output buffer, len*GetSampleSize() bytes
+ */
+void Quantizer::Quantize(const float* in, size_t len, void* out) const
+{
+	if(m_format == SAMPLE_INT16)
+		QuantizeInt16(in, len, static_cast<int16_t*>(out));
+	else if(m_format == SAMPLE_INT8)
+		QuantizeInt8(in, len, static_cast<int8_t*>(out));
+	else
+		memcpy(out, in, len * sizeof(float));
+}
+
+/**
+	@brief Encodes a single sample, rounding to nearest like the vector conversions do
+ */
+long Quantizer::QuantizeOne(float value) const
+{
+	float y = value*m_gain + m_bias;
+
+	//We build with -ffast-math, which lets the compiler assume NaN never happens and drop any float compare that
+	//would catch it. Look at the bits instead: exponent all ones with a nonzero mantissa.
+	uint32_t bits;
+	memcpy(&bits, &y, sizeof(bits));
+	if( (bits & 0x7fffffff) > 0x7f800000 )
+		return lrintf(m_minCode);
+
+	if(y < m_minCode)
+		y = m_minCode;
+	else if(y > m_maxCode)
+		y = m_maxCode;
+	return lrintf(y);
+}
+
+void Quantizer::QuantizeInt16(const float* in, size_t len, int16_t* out) const
+{
+	size_t i = 0;
+
+	//Clamp before converting: out of range floats convert to 0x80000000 on x86 (and NaN to zero on ARM) rather than
+	//saturating. maxps and fmaxnm both return the clamp value for a NaN lane no matter what the compiler assumes, so
+	//NaN ends up at the bottom of the window, same as the scalar tail.
+#if defined(__SSE2__)
+	__m128 gain = _mm_set1_ps(m_gain);
+	__m128 bias = _mm_set1_ps(m_bias);
+	__m128 lo = _mm_set1_ps(m_minCode);
+	__m128 hi = _mm_set1_ps(m_maxCode);
+	for(; i+8 <= len; i += 8)
+	{
+		__m128 a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), gain), bias);
+		__m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), gain), bias);
+		a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+		b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+		__m128i codes = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), codes);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	float32x4_t gain = vdupq_n_f32(m_gain);
+	float32x4_t bias = vdupq_n_f32(m_bias);
+	float32x4_t lo = vdupq_n_f32(m_minCode);
+	float32x4_t hi = vdupq_n_f32(m_maxCode);
+	for(; i+8 <= len; i += 8)
+	{
+		float32x4_t a = vaddq_f32(vmulq_f32(vld1q_f32(in + i), gain), bias);
+		float32x4_t b = vaddq_f32(vmulq_f32(vld1q_f32(in + i + 4), gain), bias);
+		a = vminq_f32(vmaxnmq_f32(a, lo), hi);
+		b = vminq_f32(vmaxnmq_f32(b, lo), hi);
+		int16x8_t codes = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b)));
+		vst1q_s16(out + i, codes);
+	}
+#endif
+
+	for(; i<len; i++)
+		out[i] = QuantizeOne(in[i]);
+}
+
+void Quantizer::QuantizeInt8(const float* in, size_t len, int8_t* out) const
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	__m128 gain = _mm_set1_ps(m_gain);
+	__m128 bias = _mm_set1_ps(m_bias);
+	__m128 lo = _mm_set1_ps(m_minCode);
+	__m128 hi = _mm_set1_ps(m_maxCode);
+	for(; i+16 <= len; i += 16)
+	{
+		__m128i words[4];
+		for(int j=0; j<4; j++)
+		{
+			__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4*j), gain), bias);
+			words[j] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+		}
+		__m128i codes = _mm_packs_epi16(
+			_mm_packs_epi32(words[0], words[1]),
+			_mm_packs_epi32(words[2], words[3]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), codes);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	float32x4_t gain = vdupq_n_f32(m_gain);
+	float32x4_t bias = vdupq_n_f32(m_bias);
+	float32x4_t lo = vdupq_n_f32(m_minCode);
+	float32x4_t hi = vdupq_n_f32(m_maxCode);
+	for(; i+16 <= len; i += 16)
+	{
+		int16x4_t words[4];
+		for(int j=0; j<4; j++)
+		{
+			float32x4_t v = vaddq_f32(vmulq_f32(vld1q_f32(in + i + 4*j), gain), bias);
+			words[j] = vqmovn_s32(vcvtnq_s32_f32(vminq_f32(vmaxnmq_f32(v, lo), hi)));
+		}
+		int8x16_t codes = vcombine_s8(
+			vqmovn_s16(vcombine_s16(words[0], words[1])),
+			vqmovn_s16(vcombine_s16(words[2], words[3])));
+		vst1q_s8(out + i, codes);
+	}
+#endif
+
+	for(; i<len; i++)
+		out[i] = QuantizeOne(in[i]);
+}
@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of Quantizer
+ */
+
+#ifndef Quantizer_h
+#define Quantizer_h
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+	@brief How samples of a channel are encoded on the data plane
+ */
+enum SampleFormat
+{
+	///@brief 32-bit IEEE float, as processed
+	SAMPLE_FLOAT32,
+
+	///@brief Signed 16-bit codes within the channel's range
+	SAMPLE_INT16,
+
+	///@brief Signed 8-bit codes within the channel's range
+	SAMPLE_INT8
+};
+
+bool ParseSampleFormat(const std::string& name, SampleFormat& format);
+const char* GetSampleFormatName(SampleFormat format);
+
+/**
+	@brief Converts processed samples to integer codes spread evenly over a window of values
+
+	The window follows the usual oscilloscope convention: it's range wide and centered on -offset. Codes span the full
+	range of the integer type and decode as value = code*GetScale() + GetOffset(). Values outside the window saturate
+	to the nearest end of it, NaN to the bottom.
+ */
+class Quantizer
+{
+public:
+	Quantizer();
+	Quantizer(SampleFormat format, double range, double offset);
+
+	bool IsQuantized() const
+	{ return m_format != SAMPLE_FLOAT32; }
+
+	SampleFormat GetFormat() const
+	{ return m_format; }
+
+	///@brief Width of the window
+	double GetRange() const
+	{ return m_range; }
+
+	///@brief Negated center of the window
+	double GetWindowOffset() const
+	{ return m_windowOffset; }
+
+	///@brief Value of one code step (1 for float)
+	float GetScale() const
+	{ return m_scale; }
+
+	///@brief Value of code zero (0 for float)
+	float GetOffset() const
+	{ return m_offset; }
+
+	size_t GetSampleSize() const;
+
+	void Quantize(const float* in, size_t len, void* out) const;
+
+protected:
+	long QuantizeOne(float value) const;
+	void QuantizeInt16(const float* in, size_t len, int16_t* out) const;
+	void QuantizeInt8(const float* in, size_t len, int8_t* out) const;
+
+	SampleFormat m_format;
+	double m_range;
+	double m_windowOffset;
+
+	///@brief Decoding: value = code*m_scale + m_offset
+	float m_scale;
+	float m_offset;
+
+	///@brief Encoding: code = value*m_gain + m_bias, clamped to [m_minCode, m_maxCode]
+	float m_gain;
+	float m_bias;
+	float m_minCode;
+	float m_maxCode;
+};
+
+#endif
@@ -0,0 +1,112 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SendWatchdog
+ */
+
+#include "specbridge.h"
+#include "SendWatchdog.h"
+
+using namespace std;
+
+//Longest a single send may block before the client is dropped, in ms (0 to wait forever)
+volatile unsigned int g_sendTimeout = 5000;
+
+SendWatchdog::SendWatchdog(Socket& socket)
+	: m_socket(socket)
+	, m_quit(false)
+	, m_busy(false)
+	, m_fired(false)
+{
+	m_thread = thread(&SendWatchdog::Run, this);
+}
+
+SendWatchdog::~SendWatchdog()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+/**
+	@brief Marks the start of a send that may block
+ */
+void SendWatchdog::Begin()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_busy = true;
+	m_busySince = chrono::steady_clock::now();
+}
+
+/**
+	@brief Marks the end of a send
+ */
+void SendWatchdog::End()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_busy = false;
+}
+
+void SendWatchdog::Run()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "SendWatchdog");
+#endif
+
+	unique_lock<mutex> lock(m_mutex);
+	while(!m_quit && !m_fired)
+	{
+		m_wake.wait_for(lock, chrono::milliseconds(100));
+
+		unsigned int timeout = g_sendTimeout;
+		if(!m_busy || (timeout == 0) )
+			continue;
+
+		auto stalled = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_busySince);
+		if(stalled.count() < timeout)
+			continue;
+
+		//Shutting the socket down makes the blocked send fail (this works for io_uring too, unlike SO_SNDTIMEO).
+		//The sender then closes the ring and the data thread cleans up as for any other disconnect.
+		LogWarning("Data plane client hasn't accepted data for %u ms, disconnecting\n", (unsigned int)stalled.count());
+		ZSOCKET sock = m_socket;
+#ifdef _WIN32
+		shutdown(sock, SD_BOTH);
+#else
+		shutdown(sock, SHUT_RDWR);
+#endif
+		m_fired = true;
+	}
+}
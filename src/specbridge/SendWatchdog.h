@@ -0,0 +1,80 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SendWatchdog
+ */
+
+#ifndef SendWatchdog_h
+#define SendWatchdog_h
+
+#include "../../lib/xptools/Socket.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+extern volatile unsigned int g_sendTimeout;
+
+/**
+	@brief Disconnects a data plane client that stops accepting data
+
+	Wrap every potentially blocking send in Begin() / End(). If one takes longer than g_sendTimeout, the socket is shut
+	down underneath it so the send fails and the connection is torn down, rather than blocking the data thread forever.
+ */
+class SendWatchdog
+{
+public:
+	SendWatchdog(Socket& socket);
+	~SendWatchdog();
+
+	void Begin();
+	void End();
+
+	bool HasFired()
+	{ return m_fired; }
+
+protected:
+	void Run();
+
+	Socket& m_socket;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+
+	bool m_quit;
+	bool m_busy;
+	volatile bool m_fired;
+	std::chrono::steady_clock::time_point m_busySince;
+};
+
+#endif
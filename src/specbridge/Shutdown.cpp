@@ -0,0 +1,199 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Orderly shutdown on SIGINT / SIGTERM
+
+	Almost nothing is safe to do from inside a signal handler, and the data thread may be halfway through a USB
+	transfer with g_mutex held. So the handler just pokes a self-pipe. A watcher thread picks that up and unblocks
+	everything that might be waiting on a socket, and the threads then wind down at their next frame boundary.
+ */
+
+#include "specbridge.h"
+#include "Shutdown.h"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+volatile bool g_shutdownRequested = false;
+
+//Open control plane connections (SCPI and binary), so blocked reads on them can be interrupted
+static mutex g_controlSocketMutex;
+static vector<ZSOCKET> g_controlSockets;
+
+static void Unblock(ZSOCKET sock);
+
+#ifdef _WIN32
+
+static BOOL WINAPI OnConsoleCtrl(DWORD signal);
+
+/**
+	@brief Console control handlers already run on their own thread, so we can shut down directly from it
+ */
+static BOOL WINAPI OnConsoleCtrl(DWORD /*signal*/)
+{
+	RequestShutdown();
+	return TRUE;
+}
+
+void InstallShutdownHandlers()
+{
+	SetConsoleCtrlHandler(OnConsoleCtrl, TRUE);
+}
+
+#else
+
+static int g_signalPipe[2] = {-1, -1};
+static volatile sig_atomic_t g_signalCount = 0;
+
+static void OnSignal(int signal);
+static void SignalWatcherThread();
+
+static void OnSignal(int /*signal*/)
+{
+	//A second Ctrl-C means shutdown is stuck and the user has had enough
+	if(g_signalCount++ > 0)
+		_exit(1);
+
+	char c = 0;
+	ssize_t ignored = write(g_signalPipe[1], &c, 1);
+	(void)ignored;
+}
+
+static void SignalWatcherThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "SignalWatcher");
+#endif
+
+	char c;
+	while(read(g_signalPipe[0], &c, 1) < 0)
+	{
+		if(errno != EINTR)
+			return;
+	}
+
+	RequestShutdown();
+}
+
+void InstallShutdownHandlers()
+{
+	if(0 != pipe(g_signalPipe))
+	{
+		LogError("failed to create signal pipe\n");
+		return;
+	}
+	thread(SignalWatcherThread).detach();
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = OnSignal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+#endif
+
+/**
+	@brief Starts an orderly shutdown
+
+	Stops acquisition at the next frame boundary, lets queued frames go out, and makes the main loop return so the
+	device can be released cleanly.
+ */
+void RequestShutdown()
+{
+	if(g_shutdownRequested)
+		return;
+
+	LogNotice("Shutting down...\n");
+	g_shutdownRequested = true;
+	g_waveformThreadQuit = true;
+
+	//Wake up anything blocked waiting for a connection or a command.
+	//Windows doesn't abort a pending accept() on shutdown(), only on close.
+#ifdef _WIN32
+	g_scpiSocket.Close();
+	g_dataSocket.Close();
+	g_binarySocket.Close();
+#else
+	Unblock(g_scpiSocket);
+	Unblock(g_dataSocket);
+	Unblock(g_binarySocket);
+#endif
+
+	lock_guard<mutex> lock(g_controlSocketMutex);
+	for(auto sock : g_controlSockets)
+		Unblock(sock);
+}
+
+/**
+	@brief Registers a control plane connection, so shutdown can interrupt reads on it
+ */
+void SetControlSocket(ZSOCKET sock)
+{
+	lock_guard<mutex> lock(g_controlSocketMutex);
+	g_controlSockets.push_back(sock);
+
+	//Shutdown may have started just before we got here
+	if(g_shutdownRequested)
+		Unblock(sock);
+}
+
+/**
+	@brief Unregisters a control plane connection. Must be called before the socket is closed.
+ */
+void ClearControlSocket(ZSOCKET sock)
+{
+	lock_guard<mutex> lock(g_controlSocketMutex);
+	g_controlSockets.erase(remove(g_controlSockets.begin(), g_controlSockets.end(), sock), g_controlSockets.end());
+}
+
+/**
+	@brief Makes any blocking call on a socket return
+ */
+static void Unblock(ZSOCKET sock)
+{
+#ifdef _WIN32
+	shutdown(sock, SD_BOTH);
+#else
+	shutdown(sock, SHUT_RDWR);
+#endif
+}
@@ -0,0 +1,166 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Socket options for the data plane connection
+ */
+
+#include "specbridge.h"
+#include "SocketTuning.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
+
+using namespace std;
+
+//Current settings, and the connected client (if any) to apply changes to
+static mutex g_tuningMutex;
+static SocketTuning g_tuning;
+static Socket* g_tunedSocket = nullptr;
+
+static void ApplySocketTuning(Socket& socket, const SocketTuning& tuning);
+static void SetIntOption(ZSOCKET sock, int level, int name, int value, const char* desc);
+
+SocketTuning GetSocketTuning()
+{
+	lock_guard<mutex> lock(g_tuningMutex);
+	return g_tuning;
+}
+
+/**
+	@brief Changes the data plane socket options, applying them immediately if a client is connected
+ */
+void SetSocketTuning(const SocketTuning& tuning)
+{
+	lock_guard<mutex> lock(g_tuningMutex);
+	g_tuning = tuning;
+	if(g_tunedSocket)
+		ApplySocketTuning(*g_tunedSocket, g_tuning);
+}
+
+/**
+	@brief Sets the data plane client socket, applying the current options to it
+
+	@param socket	The newly connected client, or nullptr when it disconnects
+ */
+void SetTunedSocket(Socket* socket)
+{
+	lock_guard<mutex> lock(g_tuningMutex);
+	g_tunedSocket = socket;
+	if(g_tunedSocket)
+		ApplySocketTuning(*g_tunedSocket, g_tuning);
+}
+
+/**
+	@brief Gets how much data is sitting in the data plane socket's send queue
+
+	@param queued	Bytes not yet acknowledged by the client
+	@param unsent	Bytes not yet sent at all
+
+	@return False if no client is connected or the platform can't tell us
+ */
+bool GetSendQueueDepth(int& queued, int& unsent)
+{
+	lock_guard<mutex> lock(g_tuningMutex);
+	if(!g_tunedSocket)
+		return false;
+
+#ifdef __linux__
+	ZSOCKET sock = *g_tunedSocket;
+	if(ioctl(sock, SIOCOUTQ, &queued) < 0)
+		return false;
+	if(ioctl(sock, SIOCOUTQNSD, &unsent) < 0)
+		return false;
+	return true;
+#else
+	queued = 0;
+	unsent = 0;
+	return false;
+#endif
+}
+
+static void ApplySocketTuning(Socket& socket, const SocketTuning& tuning)
+{
+	ZSOCKET sock = socket;
+
+	if(tuning.m_sendBuffer >= 0)
+		SetIntOption(sock, SOL_SOCKET, SO_SNDBUF, tuning.m_sendBuffer, "SO_SNDBUF");
+
+#ifdef __linux__
+	if(tuning.m_notSentLowWater >= 0)
+		SetIntOption(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, tuning.m_notSentLowWater, "TCP_NOTSENT_LOWAT");
+	if(tuning.m_priority >= 0)
+		SetIntOption(sock, SOL_SOCKET, SO_PRIORITY, tuning.m_priority, "SO_PRIORITY");
+	if(tuning.m_busyPoll >= 0)
+		SetIntOption(sock, SOL_SOCKET, SO_BUSY_POLL, tuning.m_busyPoll, "SO_BUSY_POLL");
+	if(tuning.m_userTimeout >= 0)
+		SetIntOption(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, tuning.m_userTimeout, "TCP_USER_TIMEOUT");
+#else
+	if( (tuning.m_notSentLowWater >= 0) || (tuning.m_priority >= 0) ||
+		(tuning.m_busyPoll >= 0) || (tuning.m_userTimeout >= 0) )
+	{
+		LogWarning("Only SO_SNDBUF and DSCP socket tuning are supported on this platform\n");
+	}
+#endif
+
+	//Probe every third of the idle time, and give up after three unanswered probes
+	if(tuning.m_keepAlive >= 0)
+	{
+		SetIntOption(sock, SOL_SOCKET, SO_KEEPALIVE, (tuning.m_keepAlive > 0) ? 1 : 0, "SO_KEEPALIVE");
+#ifdef __linux__
+		if(tuning.m_keepAlive > 0)
+		{
+			SetIntOption(sock, IPPROTO_TCP, TCP_KEEPIDLE, tuning.m_keepAlive, "TCP_KEEPIDLE");
+			SetIntOption(sock, IPPROTO_TCP, TCP_KEEPINTVL, max(1, tuning.m_keepAlive / 3), "TCP_KEEPINTVL");
+			SetIntOption(sock, IPPROTO_TCP, TCP_KEEPCNT, 3, "TCP_KEEPCNT");
+		}
+#endif
+	}
+
+	//DSCP is the top six bits of the TOS / traffic class byte.
+	//Our socket is IPv6 but may be carrying a v4-mapped connection, so set both.
+	if(tuning.m_dscp >= 0)
+	{
+		int tos = (tuning.m_dscp & 0x3f) << 2;
+		SetIntOption(sock, IPPROTO_IPV6, IPV6_TCLASS, tos, "IPV6_TCLASS");
+		setsockopt(sock, IPPROTO_IP, IP_TOS, (const char*)&tos, sizeof(tos));
+	}
+}
+
+static void SetIntOption(ZSOCKET sock, int level, int name, int value, const char* desc)
+{
+	if(0 != setsockopt(sock, level, name, (const char*)&value, sizeof(value)))
+		LogWarning("Failed to set %s to %d on data socket\n", desc, value);
+	else
+		LogDebug("Set %s to %d on data socket\n", desc, value);
+}
@@ -0,0 +1,87 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Socket options for the data plane connection
+ */
+
+#ifndef SocketTuning_h
+#define SocketTuning_h
+
+#include "../../lib/xptools/Socket.h"
+
+/**
+	@brief Options applied to the data plane socket when a client connects
+
+	A value of -1 leaves the option at the system default. Keepalives are on by default so a client that vanishes
+	while nothing is being sent (e.g. trigger disarmed) is still noticed.
+ */
+class SocketTuning
+{
+public:
+	SocketTuning()
+	: m_sendBuffer(-1)
+	, m_notSentLowWater(-1)
+	, m_priority(-1)
+	, m_dscp(-1)
+	, m_busyPoll(-1)
+	, m_userTimeout(-1)
+	, m_keepAlive(10)
+	{}
+
+	///@brief SO_SNDBUF, in bytes
+	int m_sendBuffer;
+
+	///@brief TCP_NOTSENT_LOWAT, in bytes
+	int m_notSentLowWater;
+
+	///@brief SO_PRIORITY (0-6 without CAP_NET_ADMIN)
+	int m_priority;
+
+	///@brief DiffServ code point (0-63), written to the IPv4 TOS / IPv6 traffic class
+	int m_dscp;
+
+	///@brief SO_BUSY_POLL, in microseconds
+	int m_busyPoll;
+
+	///@brief TCP_USER_TIMEOUT, in milliseconds
+	int m_userTimeout;
+
+	///@brief Idle time before sending TCP keepalives, in seconds (0 to turn keepalives off)
+	int m_keepAlive;
+};
+
+SocketTuning GetSocketTuning();
+void SetSocketTuning(const SocketTuning& tuning);
+void SetTunedSocket(Socket* socket);
+bool GetSendQueueDepth(int& queued, int& unsent);
+
+#endif
@@ -0,0 +1,142 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Startup time breakdown
+
+	Phases are reported as their own duration. Milestones (listening, calibration loaded, first frame) are reported
+	as time since the process started, since calibration loads in parallel with everything else and the phases don't
+	add up to a meaningful total on their own.
+ */
+
+#include "specbridge.h"
+#include "StartupTiming.h"
+
+using namespace std;
+
+//Close enough to process start, and set before main() runs
+static const chrono::steady_clock::time_point g_processStart = chrono::steady_clock::now();
+
+static mutex g_startupMutex;
+static vector<pair<string, double> > g_startupPhases;
+static vector<pair<string, double> > g_startupMilestones;
+
+static bool Record(vector<pair<string, double> >& list, const char* name, chrono::steady_clock::duration elapsed);
+
+StartupPhase::StartupPhase(const char* name)
+	: m_name(name)
+	, m_start(chrono::steady_clock::now())
+	, m_done(false)
+{
+}
+
+StartupPhase::~StartupPhase()
+{
+	Done();
+}
+
+/**
+	@brief Ends the phase early
+ */
+void StartupPhase::Done()
+{
+	if(m_done)
+		return;
+	m_done = true;
+
+	RecordStartupPhase(m_name, chrono::steady_clock::now() - m_start);
+}
+
+/**
+	@brief Records the duration of a phase that wasn't timed in one go, e.g. because it was interleaved with another
+ */
+void RecordStartupPhase(const char* name, chrono::steady_clock::duration elapsed)
+{
+	if(Record(g_startupPhases, name, elapsed))
+		LogDebug("Startup: %s done\n", name);
+}
+
+/**
+	@brief Records that we've reached some point in startup
+
+	@return True the first time each milestone is reached
+ */
+bool RecordStartupMilestone(const char* name)
+{
+	if(!Record(g_startupMilestones, name, chrono::steady_clock::now() - g_processStart))
+		return false;
+	LogDebug("Startup: reached %s\n", name);
+	return true;
+}
+
+/**
+	@brief Adds a timing to a list, unless there's already one with the same name
+
+	@return True if it was added
+ */
+static bool Record(vector<pair<string, double> >& list, const char* name, chrono::steady_clock::duration elapsed)
+{
+	double ms = chrono::duration_cast<chrono::microseconds>(elapsed).count() * 1e-3;
+
+	lock_guard<mutex> lock(g_startupMutex);
+	for(auto& p : list)
+	{
+		if(p.first == name)
+			return false;
+	}
+	list.push_back(make_pair(string(name), ms));
+	return true;
+}
+
+/**
+	@brief Formats the startup timing as "phase=ms,...;milestone=ms,..."
+ */
+string GetStartupReport()
+{
+	lock_guard<mutex> lock(g_startupMutex);
+
+	string ret;
+	char tmp[128];
+	for(size_t i=0; i<g_startupPhases.size(); i++)
+	{
+		auto& p = g_startupPhases[i];
+		snprintf(tmp, sizeof(tmp), "%s%s=%.1f", i ? "," : "", p.first.c_str(), p.second);
+		ret += tmp;
+	}
+	ret += ";";
+	for(size_t i=0; i<g_startupMilestones.size(); i++)
+	{
+		auto& p = g_startupMilestones[i];
+		snprintf(tmp, sizeof(tmp), "%s%s=%.1f", i ? "," : "", p.first.c_str(), p.second);
+		ret += tmp;
+	}
+	return ret;
+}
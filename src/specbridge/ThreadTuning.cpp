@@ -0,0 +1,182 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief CPU affinity and scheduling for the bridge's threads
+ */
+
+#include "specbridge.h"
+#include "ThreadTuning.h"
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+using namespace std;
+
+//Configured from the command line before any threads start, read-only afterwards
+static ThreadPolicy g_threadPolicies[THREAD_ROLE_COUNT];
+
+static const char* g_threadRoleNames[THREAD_ROLE_COUNT] =
+{
+	"acquisition",
+	"network",
+	"processing"
+};
+
+//CPU numbers at or above this can't go in a cpu_set_t
+#ifdef __linux__
+static const long g_cpuLimit = CPU_SETSIZE;
+#else
+static const long g_cpuLimit = 1024;
+#endif
+
+/**
+	@brief Parses a CPU list like "2,4-7"
+
+	@return False if the list is malformed, has an empty element, or names a CPU past CPU_SETSIZE
+ */
+bool ParseCpuList(const string& str, vector<int>& cpus)
+{
+	cpus.clear();
+
+	const char* p = str.c_str();
+	while(*p)
+	{
+		char* end;
+		long first = strtol(p, &end, 10);
+		if( (end == p) || (first < 0) || (first >= g_cpuLimit) )
+			return false;
+		long last = first;
+		p = end;
+
+		if(*p == '-')
+		{
+			p++;
+			last = strtol(p, &end, 10);
+			if( (end == p) || (last < first) || (last >= g_cpuLimit) )
+				return false;
+			p = end;
+		}
+
+		for(long i=first; i<=last; i++)
+			cpus.push_back(i);
+
+		if(*p == ',')
+		{
+			p++;
+			if(*p == '\0')
+				return false;
+		}
+		else if(*p != '\0')
+			return false;
+	}
+
+	return !cpus.empty();
+}
+
+ThreadPolicy& GetThreadPolicy(ThreadRole role)
+{
+	return g_threadPolicies[role];
+}
+
+/**
+	@brief Applies the configured affinity and priority to the calling thread
+
+	@param role		What the thread does
+	@param index	Index of the thread within its role (worker pool threads only)
+ */
+void ApplyThreadPolicy(ThreadRole role, size_t index)
+{
+	auto& policy = g_threadPolicies[role];
+	if(policy.m_cpus.empty() && (policy.m_priority == 0) )
+		return;
+
+#ifdef __linux__
+	if(!policy.m_cpus.empty())
+	{
+		//Workers are pinned one per CPU, round robin. Everything else may float over its whole set.
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if(role == THREAD_PROCESSING)
+			CPU_SET(policy.m_cpus[index % policy.m_cpus.size()], &set);
+		else
+		{
+			for(auto cpu : policy.m_cpus)
+				CPU_SET(cpu, &set);
+		}
+
+		int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if(err != 0)
+			LogWarning("Failed to set CPU affinity for %s thread (%s)\n", g_threadRoleNames[role], strerror(err));
+	}
+
+	if(policy.m_priority > 0)
+	{
+		sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = policy.m_priority;
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if(err != 0)
+		{
+			LogWarning(
+				"Failed to set SCHED_FIFO priority %d for %s thread (%s), needs CAP_SYS_NICE or an rtprio limit\n",
+				policy.m_priority, g_threadRoleNames[role], strerror(err));
+		}
+	}
+#else
+	(void)index;
+	LogWarning("Thread affinity and priority are only supported on Linux, ignoring for %s thread\n",
+		g_threadRoleNames[role]);
+#endif
+}
+
+/**
+	@brief Locks all current and future memory into RAM so page faults can't stall acquisition
+ */
+bool LockMemory()
+{
+#ifdef __linux__
+	if(0 != mlockall(MCL_CURRENT | MCL_FUTURE))
+	{
+		LogWarning("mlockall failed (%s), needs CAP_IPC_LOCK or a higher memlock limit\n", strerror(errno));
+		return false;
+	}
+	return true;
+#else
+	LogWarning("Memory locking is only supported on Linux\n");
+	return false;
+#endif
+}
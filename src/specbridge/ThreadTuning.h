@@ -0,0 +1,82 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief CPU affinity and scheduling for the bridge's threads
+ */
+
+#ifndef ThreadTuning_h
+#define ThreadTuning_h
+
+#include <string>
+#include <vector>
+
+/**
+	@brief Groups of threads that can be scheduled separately
+ */
+enum ThreadRole
+{
+	///@brief The data plane thread, which talks to the device over USB
+	THREAD_ACQUISITION,
+
+	///@brief The data plane sender
+	THREAD_NETWORK,
+
+	///@brief Worker pool threads running heavy processing stages
+	THREAD_PROCESSING,
+
+	THREAD_ROLE_COUNT
+};
+
+/**
+	@brief Where and how the threads in one role run
+ */
+class ThreadPolicy
+{
+public:
+	ThreadPolicy()
+	: m_priority(0)
+	{}
+
+	///@brief CPUs to run on (empty = anywhere)
+	std::vector<int> m_cpus;
+
+	///@brief SCHED_FIFO priority (0 = normal time-sharing scheduling)
+	int m_priority;
+};
+
+bool ParseCpuList(const std::string& str, std::vector<int>& cpus);
+
+ThreadPolicy& GetThreadPolicy(ThreadRole role);
+void ApplyThreadPolicy(ThreadRole role, size_t index = 0);
+bool LockMemory();
+
+#endif
@@ -0,0 +1,146 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Host clock sampling for frame timestamps
+ */
+
+#include "specbridge.h"
+#include "Timestamps.h"
+#include <time.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static ReferenceClock g_refClock = REFCLOCK_NONE;
+static clockid_t g_refClockID = CLOCK_MONOTONIC;
+
+static int64_t ReadClock(clockid_t id);
+#ifdef __linux__
+static clockid_t FileToClockID(int fd);
+
+/**
+	@brief Dynamic clock ID for a PTP clock device (FD_TO_CLOCKID from the kernel's posix-timers.h)
+ */
+static clockid_t FileToClockID(int fd)
+{
+	return (clockid_t)( (((unsigned int)~fd) << 3) | 3 );
+}
+#endif
+
+static int64_t ReadClock(clockid_t id)
+{
+	timespec ts;
+	if(0 != clock_gettime(id, &ts))
+		return 0;
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+	@brief Gets the current CLOCK_MONOTONIC time, in nanoseconds
+ */
+int64_t GetMonotonicTime()
+{
+	return ReadClock(CLOCK_MONOTONIC);
+}
+
+/**
+	@brief Samples all host clocks
+
+	The realtime and reference clocks are read between two reads of the monotonic clock, and the monotonic timestamp
+	is the midpoint of those, so the error in the correlation is at most half the time taken by the reads.
+ */
+ClockSample SampleClocks()
+{
+	ClockSample ret;
+	int64_t before = ReadClock(CLOCK_MONOTONIC);
+	ret.m_real = ReadClock(CLOCK_REALTIME);
+	if(g_refClock != REFCLOCK_NONE)
+		ret.m_ref = ReadClock(g_refClockID);
+	int64_t after = ReadClock(CLOCK_MONOTONIC);
+	ret.m_mono = before + (after - before)/2;
+	return ret;
+}
+
+/**
+	@brief Selects the reference clock sampled with each frame
+
+	@param name	"none", "tai", or the path to a PTP hardware clock device
+
+	@return False if the clock could not be opened
+ */
+bool SetReferenceClock(const string& name)
+{
+	if(name == "none")
+	{
+		g_refClock = REFCLOCK_NONE;
+		return true;
+	}
+
+#ifdef __linux__
+	if(name == "tai")
+	{
+		g_refClock = REFCLOCK_TAI;
+		g_refClockID = CLOCK_TAI;
+		return true;
+	}
+
+	//Anything else is a PTP clock device. Keep it open for the life of the process.
+	int fd = open(name.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		LogError("Failed to open PTP clock %s\n", name.c_str());
+		return false;
+	}
+	g_refClock = REFCLOCK_PTP;
+	g_refClockID = FileToClockID(fd);
+	if(ReadClock(g_refClockID) == 0)
+	{
+		LogError("%s does not appear to be a PTP clock\n", name.c_str());
+		g_refClock = REFCLOCK_NONE;
+		close(fd);
+		return false;
+	}
+	return true;
+#else
+	LogError("Reference clocks are only supported on Linux\n");
+	return false;
+#endif
+}
+
+ReferenceClock GetReferenceClock()
+{
+	return g_refClock;
+}
@@ -0,0 +1,93 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Host clock sampling for frame timestamps
+ */
+
+#ifndef Timestamps_h
+#define Timestamps_h
+
+#include <string>
+#include <stdint.h>
+
+/**
+	@brief Optional third clock sampled alongside CLOCK_MONOTONIC and CLOCK_REALTIME
+ */
+enum ReferenceClock
+{
+	REFCLOCK_NONE	= 0,
+
+	///@brief CLOCK_TAI (only meaningful if something like ptp4l or chrony has set the kernel's TAI offset)
+	REFCLOCK_TAI	= 1,
+
+	///@brief A PTP hardware clock, e.g. /dev/ptp0
+	REFCLOCK_PTP	= 2
+};
+
+/**
+	@brief All host clocks, sampled as close together as we can manage
+
+	All values are in nanoseconds. m_ref is zero if no reference clock is configured.
+ */
+class ClockSample
+{
+public:
+	ClockSample()
+	: m_mono(0)
+	, m_real(0)
+	, m_ref(0)
+	{}
+
+	int64_t m_mono;
+	int64_t m_real;
+	int64_t m_ref;
+
+	/**
+		@brief Converts a CLOCK_MONOTONIC time near this sample to CLOCK_REALTIME
+	 */
+	int64_t MonoToReal(int64_t mono) const
+	{ return m_real + (mono - m_mono); }
+
+	/**
+		@brief Converts a CLOCK_MONOTONIC time near this sample to the reference clock (zero if there isn't one)
+	 */
+	int64_t MonoToRef(int64_t mono) const
+	{ return m_ref ? m_ref + (mono - m_mono) : 0; }
+};
+
+int64_t GetMonotonicTime();
+ClockSample SampleClocks();
+
+bool SetReferenceClock(const std::string& name);
+ReferenceClock GetReferenceClock();
+
+#endif
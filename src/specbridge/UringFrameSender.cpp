@@ -0,0 +1,293 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of UringFrameSender
+ */
+
+#include "specbridge.h"
+#include "UringFrameSender.h"
+
+#ifdef HAVE_LIBURING
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+using namespace std;
+
+//Maximum number of batches pinned waiting for zero-copy notifications before Send() blocks
+#define MAX_BATCHES 8
+
+//Below this many bytes, page pinning costs more than the copy it saves
+#define ZEROCOPY_THRESHOLD 16384
+
+UringFrameSender::UringFrameSender(Socket& socket)
+	: m_socket(socket)
+	, m_open(false)
+	, m_failed(false)
+	, m_sending(false)
+	, m_zeroCopy(true)
+{
+	int err = io_uring_queue_init(MAX_BATCHES * 2, &m_ring, 0);
+	if(err < 0)
+	{
+		LogWarning("io_uring unavailable (%s)\n", strerror(-err));
+		return;
+	}
+	m_open = true;
+
+	//Zero-copy sends need liburing 2.3 at build time
+#ifndef IORING_CQE_F_NOTIF
+	m_zeroCopy = false;
+#endif
+}
+
+UringFrameSender::~UringFrameSender()
+{
+	if(!m_open)
+		return;
+
+	//The kernel may still be reading from our buffers, don't free them out from under it
+	while(!m_batches.empty())
+	{
+		if(!Reap(true))
+			break;
+	}
+
+	io_uring_queue_exit(&m_ring);
+}
+
+bool UringFrameSender::Send(const vector<shared_ptr<Frame> >& frames)
+{
+	//Previous batch has to be on the wire before this one can go, and cap how much is pinned for zero-copy
+	Reap(false);
+	while(!m_failed && (m_sending || (m_batches.size() >= MAX_BATCHES)) )
+	{
+		if(!Reap(true))
+			m_failed = true;
+	}
+	if(m_failed)
+		return false;
+
+	//Take our own references to everything the kernel is going to read
+	GetHeaders(frames);
+	auto batch = new Batch;
+	m_batches.push_back(unique_ptr<Batch>(batch));
+	batch->m_frames = frames;
+	batch->m_headers.swap(m_headers);
+	batch->m_first = 0;
+	batch->m_sent = false;
+	batch->m_notificationsPending = 0;
+
+	batch->m_iov.reserve(frames.size() * 2);
+	size_t block = 0;
+	for(auto& frame : frames)
+	{
+		for(auto& channel : frame->m_channels)
+		{
+			if(!batch->m_headers.empty())
+				batch->m_iov.push_back({ &batch->m_headers[block], sizeof(FrameHeader) });
+			block ++;
+
+			batch->m_iov.push_back({ const_cast<void*>(channel.GetPayload()), channel.GetPayloadSize() });
+		}
+	}
+
+	Submit(batch);
+	return !m_failed;
+}
+
+/**
+	@brief Queues a send of everything in the batch that hasn't gone out yet
+ */
+void UringFrameSender::Submit(Batch* batch)
+{
+	memset(&batch->m_msg, 0, sizeof(batch->m_msg));
+	batch->m_msg.msg_iov = &batch->m_iov[batch->m_first];
+	batch->m_msg.msg_iovlen = min(batch->m_iov.size() - batch->m_first, (size_t)IOV_MAX);
+
+	size_t len = 0;
+	for(size_t i=0; i<batch->m_msg.msg_iovlen; i++)
+		len += batch->m_msg.msg_iov[i].iov_len;
+
+	auto sqe = io_uring_get_sqe(&m_ring);
+	if(!sqe)
+	{
+		LogError("io_uring submission queue full\n");
+		m_failed = true;
+		batch->m_sent = true;
+		return;
+	}
+
+	ZSOCKET sock = m_socket;
+	int flags = MSG_NOSIGNAL | MSG_WAITALL;
+#ifdef IORING_CQE_F_NOTIF
+	if(m_zeroCopy && (len >= ZEROCOPY_THRESHOLD) )
+		io_uring_prep_sendmsg_zc(sqe, sock, &batch->m_msg, flags);
+	else
+#endif
+		io_uring_prep_sendmsg(sqe, sock, &batch->m_msg, flags);
+	io_uring_sqe_set_data(sqe, batch);
+
+	int err = io_uring_submit(&m_ring);
+	if(err < 0)
+	{
+		LogError("io_uring_submit failed (%s)\n", strerror(-err));
+		m_failed = true;
+		batch->m_sent = true;
+		return;
+	}
+	m_sending = true;
+}
+
+/**
+	@brief Handles every completion that's ready
+
+	@param block	Wait for at least one completion if none are ready
+
+	@return False if waiting failed
+ */
+bool UringFrameSender::Reap(bool block)
+{
+	if(block)
+	{
+		io_uring_cqe* cqe;
+		int err;
+		do
+		{
+			err = io_uring_wait_cqe(&m_ring, &cqe);
+		} while(err == -EINTR);
+
+		if(err < 0)
+		{
+			LogError("io_uring_wait_cqe failed (%s)\n", strerror(-err));
+			return false;
+		}
+	}
+
+	io_uring_cqe* cqes[16];
+	unsigned int count;
+	while( (count = io_uring_peek_batch_cqe(&m_ring, cqes, 16)) > 0)
+	{
+		for(unsigned int i=0; i<count; i++)
+			OnCompletion(cqes[i]);
+		io_uring_cq_advance(&m_ring, count);
+	}
+
+	//Release batches the kernel is completely done with
+	for(size_t i=0; i<m_batches.size(); )
+	{
+		auto& b = m_batches[i];
+		if(b->m_sent && (b->m_notificationsPending == 0) )
+			m_batches.erase(m_batches.begin() + i);
+		else
+			i++;
+	}
+
+	return true;
+}
+
+void UringFrameSender::OnCompletion(io_uring_cqe* cqe)
+{
+	auto batch = reinterpret_cast<Batch*>(io_uring_cqe_get_data(cqe));
+
+#ifdef IORING_CQE_F_NOTIF
+	if(cqe->flags & IORING_CQE_F_NOTIF)
+	{
+		batch->m_notificationsPending --;
+		return;
+	}
+#endif
+
+	//A zero-copy send is followed by a notification once the buffers are released
+	if(cqe->flags & IORING_CQE_F_MORE)
+		batch->m_notificationsPending ++;
+
+	OnSendComplete(batch, cqe->res);
+}
+
+/**
+	@brief Handles the result of a send, resubmitting whatever's left over after a short write
+ */
+void UringFrameSender::OnSendComplete(Batch* batch, int result)
+{
+	m_sending = false;
+
+	if(result < 0)
+	{
+		if( (result == -EINTR) || (result == -EAGAIN) )
+		{
+			Submit(batch);
+			return;
+		}
+
+		//Older kernels and some socket types can't do zero-copy, fall back to copying
+		if(m_zeroCopy && ( (result == -EINVAL) || (result == -EOPNOTSUPP) ) )
+		{
+			LogVerbose("Zero-copy send not supported (%s), falling back to regular sends\n", strerror(-result));
+			m_zeroCopy = false;
+			Submit(batch);
+			return;
+		}
+
+		LogVerbose("Send failed (%s)\n", strerror(-result));
+		m_failed = true;
+		batch->m_sent = true;
+		return;
+	}
+	if(result == 0)
+	{
+		m_failed = true;
+		batch->m_sent = true;
+		return;
+	}
+
+	size_t remaining = result;
+	auto& iov = batch->m_iov;
+	while( (batch->m_first < iov.size()) && (remaining >= iov[batch->m_first].iov_len) )
+	{
+		remaining -= iov[batch->m_first].iov_len;
+		batch->m_first ++;
+	}
+	if(remaining)
+	{
+		iov[batch->m_first].iov_base = (uint8_t*)iov[batch->m_first].iov_base + remaining;
+		iov[batch->m_first].iov_len -= remaining;
+	}
+
+	if(batch->m_first < iov.size())
+		Submit(batch);
+	else
+		batch->m_sent = true;
+}
+
+#endif
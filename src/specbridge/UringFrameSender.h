@@ -0,0 +1,109 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of UringFrameSender
+ */
+
+#ifndef UringFrameSender_h
+#define UringFrameSender_h
+
+#ifdef HAVE_LIBURING
+
+#include "FrameSender.h"
+#include <liburing.h>
+#include <sys/uio.h>
+
+/**
+	@brief Asynchronous sender built on io_uring
+
+	Send() queues the batch to the kernel and returns immediately, so the next batch can be collected while the
+	previous one is still going out. Only one send is outstanding at a time, to keep the byte stream in order, but
+	batches sent with MSG_ZEROCOPY stay pinned here until the kernel says it is done with their buffers.
+ */
+class UringFrameSender : public FrameSender
+{
+public:
+	UringFrameSender(Socket& socket);
+	virtual ~UringFrameSender();
+
+	bool IsOpen()
+	{ return m_open; }
+
+	virtual bool Send(const std::vector<std::shared_ptr<Frame> >& frames) override;
+
+protected:
+
+	/**
+		@brief A batch the kernel may still be reading from
+	 */
+	class Batch
+	{
+	public:
+		std::vector<std::shared_ptr<Frame> > m_frames;
+		std::vector<FrameHeader> m_headers;
+		std::vector<iovec> m_iov;
+		msghdr m_msg;
+
+		///@brief Index of the first iovec not yet fully sent
+		size_t m_first;
+
+		///@brief True once every byte has been handed to the kernel (or the send failed)
+		bool m_sent;
+
+		///@brief Zero-copy completion notifications we're still waiting on
+		size_t m_notificationsPending;
+	};
+
+	void Submit(Batch* batch);
+	bool Reap(bool block);
+	void OnCompletion(io_uring_cqe* cqe);
+	void OnSendComplete(Batch* batch, int result);
+
+	Socket& m_socket;
+	io_uring m_ring;
+	bool m_open;
+
+	///@brief Set once a send fails, the client is considered gone from then on
+	bool m_failed;
+
+	///@brief True while a send is queued in the kernel
+	bool m_sending;
+
+	///@brief Cleared if the kernel or socket turns out not to support zero-copy sends
+	bool m_zeroCopy;
+
+	std::vector<std::unique_ptr<Batch> > m_batches;
+};
+
+#endif
+
+#endif
@@ -33,17 +33,57 @@
 	@brief Waveform data thread (data plane traffic only, no control plane SCPI)
  */
 #include "specbridge.h"
+#include "Acquisition.h"
+#include "ChangeDetector.h"
+#include "Device.h"
+#include "EventCapture.h"
+#include "NonlinearityCorrection.h"
+#include "ProcessingPipeline.h"
+#include "FrameReorderBuffer.h"
+#include "FrameRing.h"
+#include "FrameSender.h"
+#include "Hotplug.h"
+#include "SendWatchdog.h"
+#include "SocketTuning.h"
+#include "StartupTiming.h"
+#include "ThreadTuning.h"
+#include "WorkerPool.h"
 #include <string.h>
 
 using namespace std;
 
 volatile bool g_waveformThreadQuit = false;
 
+//Send a FrameHeader before each frame
+volatile bool g_frameHeaders = false;
+
+//Frame batching on the data plane
+volatile unsigned int g_batchLatency = 0;
+volatile unsigned int g_batchMaxFrames = 64;
+
+//Number of processed frames that can be queued for sending
+size_t g_ringDepth = 256;
+
+//Data plane connection status, for SCPI queries
+volatile bool g_dataClientConnected = false;
+atomic<uint64_t> g_framesDropped(0);
+
+static void ProcessFrame(Frame& frame);
+static bool QueueFrames(
+	FrameRing& ring,
+	FrameReorderBuffer& reorder,
+	ChangeDetector& changes,
+	EventCapture& events,
+	size_t& inFlight,
+	size_t maxInFlight);
+static void SenderThread(FrameSender* sender, FrameRing* ring, SendWatchdog* watchdog);
+
 void WaveformServerThread()
 {
 #ifdef __linux__
 	pthread_setname_np(pthread_self(), "WaveformThread");
 #endif
+	ApplyThreadPolicy(THREAD_ACQUISITION);
 
 	Socket client = g_dataSocket.Accept();
 	LogVerbose("Client connected to data plane socket\n");
@@ -52,52 +92,228 @@ void WaveformServerThread()
 		return;
 	if(!client.DisableNagle())
 		LogWarning("Failed to disable Nagle on socket, performance may be poor\n");
+	SetTunedSocket(&client);
+	g_dataClientConnected = true;
+	g_framesDropped = 0;
+
+	//Network I/O runs on its own thread so a slow client doesn't hold up acquisition,
+	//and so frames that pile up can go out together in one batch.
+	//If the client stops reading, frames are dropped from the ring and the watchdog eventually disconnects it.
+	SendWatchdog watchdog(client);
+	FrameRing ring(g_ringDepth);
+	auto sender = FrameSender::Create(client);
+	thread senderThread(SenderThread, sender.get(), &ring, &watchdog);
 
-	const int framesize = 3699;
-	uint16_t* framePixels = new uint16_t[framesize];
-	float* frameFlattened = new float[g_numPixels];
+	//Frames with heavy processing go to the worker pool and may finish out of order.
+	//Everything goes through the reorder buffer so frames are always sent in the order they were acquired.
+	FrameReorderBuffer reorder;
+	ChangeDetector changes;
+	EventCapture events;
+	uint64_t sequence = 0;
+	size_t inFlight = 0;
+	size_t maxInFlight = g_workerPool ? 2*g_workerPool->GetThreadCount() : 0;
+
+	AcquisitionEngine engine;
+	bool gap = false;
 
 	while(!g_waveformThreadQuit)
 	{
 		//wait if trigger not armed
 		if(!g_triggerArmed)
 		{
+			engine.Idle();
+			if(!QueueFrames(ring, reorder, changes, events, inFlight, inFlight))
+				break;
 			this_thread::sleep_for(chrono::microseconds(1000));
 			continue;
 		}
 
-		//Acquire data
+		//Hold off until the frame rate allows the next trigger (one-shot captures go right away). Sleep in short
+		//slices so a long frame period doesn't hold up stopping acquisition or shutting down.
+		if(!g_triggerOneShot)
 		{
-			lock_guard<mutex> lock(g_mutex);
+			auto due = engine.GetNextTriggerTime();
+			auto now = chrono::steady_clock::now();
+			if(due > now)
+			{
+				this_thread::sleep_until(min(due, now + chrono::milliseconds(10)));
+				if(!QueueFrames(ring, reorder, changes, events, inFlight, inFlight))
+					break;
+				continue;
+			}
+		}
 
-			//Trigger an acquisition
-			int err;
-			if(0 != (err = triggerAcquisition(&g_hDevice)))
-				LogError("failed to trigger acquisition, code %d\n", err);
+		auto frame = make_shared<Frame>();
+		frame->m_sequence = sequence;
+		if(!engine.AcquireFrame(*frame))
+		{
+			if(!g_restartOnUsbError && !IsHotplugMonitorRunning())
+				break;
 
-			//Get the frame data
-			if(0 != (err = getFrame(framePixels, 0xffff, &g_hDevice)))
-			{
-				LogError("failed to get frame, code %d\n", err);
+			//Keep trying (or wait for it to be plugged back in) until the device comes back. Settings are re-applied
+			//and calibration is reused unless it's a different spectrometer. Flag the discontinuity on the next frame.
+			engine.Reset();
+			if(!RecoverDevice())
 				break;
-			}
+			gap = true;
+			continue;
+		}
+		if(gap)
+		{
+			frame->m_flags |= FRAME_FLAG_GAP;
+			gap = false;
+		}
+		if( (sequence == 0) && RecordStartupMilestone("first_frame") )
+			LogVerbose("Startup timing (ms): %s\n", GetStartupReport().c_str());
+		auto framePixels = &frame->m_raw[0];
 
-			if(g_triggerOneShot)
-				g_triggerArmed = false;
+		//Save a dark reference if one was requested
+		if(g_darkCaptureRequested)
+		{
+			auto nonlinearity = GetNonlinearityCorrection();
+			auto lut = nonlinearity->GetTable();
+			auto dark = make_shared<vector<float> >(g_numPixels);
+			for(int i=0; i<g_numPixels; i++)
+				(*dark)[i] = lut[framePixels[i+Frame::RAW_OFFSET]];
+			SetDarkFrame(dark);
+			g_darkCaptureRequested = false;
+			LogVerbose("Captured dark frame\n");
 		}
 
-		//Frame data seems to be *mirrored* - shortest wavelengths at right... But we'll fix that clientside.
-		for(int i=0; i<g_numPixels; i++)
-			frameFlattened[i] = framePixels[i+32];
+		//Run the pipeline for each enabled channel, on the pool if it's worth it
+		GetChannelPipelines(frame->m_channels);
+		if(g_changeDetection && !frame->m_channels.empty())
+			frame->m_bands.resize(max(1u, min((unsigned int)g_changeBands, (unsigned int)g_numPixels)));
+		sequence ++;
+		inFlight ++;
+		if(g_workerPool && frame->IsHeavy())
+		{
+			g_workerPool->Submit([frame, &reorder]
+				{
+					ProcessFrame(*frame);
+					reorder.Complete(frame);
+				});
+		}
+		else
+		{
+			ProcessFrame(*frame);
+			reorder.Complete(frame);
+		}
 
-		//Send the flattened data to the client
-		if(!client.SendLooped((uint8_t*)frameFlattened, g_numPixels * sizeof(float)))
+		//Send whatever is ready, waiting if we're too far ahead of the pool
+		if(!QueueFrames(ring, reorder, changes, events, inFlight, maxInFlight))
 			break;
+		g_framesDropped = ring.GetDropCount();
 	}
 
+	//Wait for frames still on the pool, since they reference our reorder buffer
+	for(; inFlight > 0; inFlight--)
+		reorder.PopNext(true);
+
+	//Flush whatever is left, but don't wait forever on a stalled client
+	ring.Close();
+	senderThread.join();
+	watchdog.Begin();
+	sender.reset();
+	watchdog.End();
+
+	SetTunedSocket(nullptr);
+	g_dataClientConnected = false;
+
 	LogDebug("Client disconnected from data plane socket\n");
+}
+
+/**
+	@brief Runs a frame through the pipelines of each channel it was acquired with
+ */
+static void ProcessFrame(Frame& frame)
+{
+	//Frame data seems to be *mirrored* - shortest wavelengths at right... But we'll fix that clientside.
+	auto raw = &frame.m_raw[Frame::RAW_OFFSET];
+	for(size_t i=0; i<frame.m_channels.size(); i++)
+	{
+		//Change detection looks at the first channel
+		auto& channel = frame.m_channels[i];
+		auto bands = (i == 0) ? &frame.m_bands : nullptr;
+		channel.m_pipeline->Process(raw, channel.m_samples, frame.m_scratch, bands);
+
+		//Integer formats only send the codes, so the float samples can go right away
+		if(channel.m_quantizer.IsQuantized())
+		{
+			auto& samples = channel.m_samples;
+			channel.m_packed.resize(samples.size() * channel.m_quantizer.GetSampleSize());
+			channel.m_quantizer.Quantize(&samples[0], samples.size(), &channel.m_packed[0]);
+			vector<float>().swap(samples);
+		}
+	}
+
+	//Only the samples are sent, so don't hold the raw and working buffers while the frame waits in the send ring
+	vector<uint16_t>().swap(frame.m_raw);
+	vector<float>().swap(frame.m_scratch);
+}
+
+/**
+	@brief Queues finished frames for sending, in sequence order
+
+	@param ring			Frames waiting to be sent
+	@param reorder		Frames that have finished processing
+	@param changes		Change detection, which drops frames that haven't changed enough to be worth sending
+	@param events		Event capture, which decides which frames actually get sent
+	@param inFlight		Number of frames acquired but not yet queued
+	@param maxInFlight	Block until no more than this many frames are still in flight
+
+	@return False if the client disconnected
+ */
+static bool QueueFrames(
+	FrameRing& ring,
+	FrameReorderBuffer& reorder,
+	ChangeDetector& changes,
+	EventCapture& events,
+	size_t& inFlight,
+	size_t maxInFlight)
+{
+	vector<shared_ptr<Frame> > ready;
+	while(inFlight > 0)
+	{
+		auto frame = reorder.PopNext(inFlight > maxInFlight);
+		if(!frame)
+			break;
+		inFlight --;
+
+		//Unchanged frames go no further, not even into the event history.
+		//An event's frames are queued together so they go out in the same batch.
+		if(!changes.Offer(*frame))
+			continue;
+		events.Offer(frame, ready);
+		if(ready.empty())
+			continue;
+		if(!ring.Push(ready))
+			return false;
+		ready.clear();
+	}
+	return true;
+}
+
+/**
+	@brief Sends queued frames to the client, batching frames that are ready at the same time
+ */
+static void SenderThread(FrameSender* sender, FrameRing* ring, SendWatchdog* watchdog)
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "SenderThread");
+#endif
+	ApplyThreadPolicy(THREAD_NETWORK);
+
+	vector<shared_ptr<Frame> > batch;
+	while(ring->PopBatch(batch, max(1u, (unsigned int)g_batchMaxFrames), chrono::microseconds(g_batchLatency)))
+	{
+		watchdog->Begin();
+		bool ok = sender->Send(batch);
+		watchdog->End();
+		if(!ok)
+			break;
+	}
 
-	//Clean up
-	delete[] framePixels;
-	delete[] frameFlattened;
+	//Client is gone (or we're shutting down), stop the data thread
+	ring->Close();
 }
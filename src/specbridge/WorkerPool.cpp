@@ -0,0 +1,140 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WorkerPool
+ */
+
+#include "specbridge.h"
+#include "ThreadTuning.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+//Pool shared by all data threads, or null if frames are processed inline
+WorkerPool* g_workerPool = nullptr;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WorkerPool::WorkerPool(size_t nthreads)
+	: m_nextQueue(0)
+	, m_pending(0)
+	, m_quit(false)
+{
+	for(size_t i=0; i<nthreads; i++)
+		m_queues.push_back(unique_ptr<WorkQueue>(new WorkQueue));
+	for(size_t i=0; i<nthreads; i++)
+		m_threads.push_back(thread(&WorkerPool::WorkerThread, this, i));
+}
+
+/**
+	@brief Stops all workers. Tasks that have not started yet are discarded.
+ */
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+
+	for(auto& t : m_threads)
+		t.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Task management
+
+/**
+	@brief Queues a task to run on one of the workers
+ */
+void WorkerPool::Submit(function<void()> task)
+{
+	//Count the task before it's visible in a queue so m_pending can never underflow.
+	//Take the sleep lock so a worker can't miss the wakeup between checking m_pending and going to sleep.
+	{
+		lock_guard<mutex> lock(m_sleepMutex);
+		m_pending ++;
+	}
+
+	auto& q = *m_queues[m_nextQueue++ % m_queues.size()];
+	{
+		lock_guard<mutex> lock(q.m_mutex);
+		q.m_tasks.push_back(move(task));
+	}
+	m_wake.notify_one();
+}
+
+/**
+	@brief Gets the next task for a worker: its own oldest task if it has one, otherwise the oldest task of another
+ */
+bool WorkerPool::TryPop(size_t index, function<void()>& task)
+{
+	size_t n = m_queues.size();
+	for(size_t i=0; i<n; i++)
+	{
+		auto& q = *m_queues[(index + i) % n];
+		lock_guard<mutex> lock(q.m_mutex);
+		if(!q.m_tasks.empty())
+		{
+			task = move(q.m_tasks.front());
+			q.m_tasks.pop_front();
+			m_pending --;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkerPool::WorkerThread(size_t index)
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), ("FrameWorker" + to_string(index)).c_str());
+#endif
+	ApplyThreadPolicy(THREAD_PROCESSING, index);
+
+	function<void()> task;
+	while(true)
+	{
+		if(TryPop(index, task))
+		{
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]{ return m_quit || (m_pending > 0); });
+		if(m_quit)
+			break;
+	}
+}
@@ -0,0 +1,95 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WorkerPool
+ */
+
+#ifndef WorkerPool_h
+#define WorkerPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+	@brief Work-stealing thread pool shared by all data threads for expensive frame processing
+
+	Each worker has its own queue. Submitted tasks are spread across the queues round-robin, and a worker whose queue
+	runs dry steals from the others. Tasks are always taken oldest-first (from either end of its own queue or someone
+	else's) since frame tasks are independent of each other and finishing the oldest frame first keeps latency in the
+	reorder stage low.
+ */
+class WorkerPool
+{
+public:
+	WorkerPool(size_t nthreads);
+	~WorkerPool();
+
+	void Submit(std::function<void()> task);
+
+	size_t GetThreadCount() const
+	{ return m_threads.size(); }
+
+protected:
+	void WorkerThread(size_t index);
+	bool TryPop(size_t index, std::function<void()>& task);
+
+	///@brief A single worker's task queue
+	class WorkQueue
+	{
+	public:
+		std::mutex m_mutex;
+		std::deque<std::function<void()> > m_tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue> > m_queues;
+	std::vector<std::thread> m_threads;
+
+	///@brief Round-robin pointer for Submit()
+	std::atomic<size_t> m_nextQueue;
+
+	///@brief Number of tasks submitted but not yet started
+	std::atomic<size_t> m_pending;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_quit;
+};
+
+extern WorkerPool* g_workerPool;
+
+#endif
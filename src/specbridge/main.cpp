@@ -34,14 +34,25 @@
  */
 
 #include "specbridge.h"
+#include "Acquisition.h"
 #include "AseqSCPIServer.h"
-#include <signal.h>
+#include "BinaryControlServer.h"
+#include "Calibration.h"
+#include "Device.h"
+#include "FrameSender.h"
+#include "Hotplug.h"
+#include "NonlinearityCorrection.h"
+#include "ProcessingPipeline.h"
+#include "SendWatchdog.h"
+#include "Shutdown.h"
+#include "SocketTuning.h"
+#include "StartupTiming.h"
+#include "ThreadTuning.h"
+#include "Timestamps.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
-vector<string> explode(const string& str, char separator);
-string Trim(const string& str);
-
 void help();
 
 void help()
@@ -53,6 +64,36 @@ void help()
 			"    --help                        : this message...\n"
 			"    --scpi-port port              : specifies the SCPI control plane port (default 5025)\n"
 			"    --waveform-port port          : specifies the binary waveform data port (default 5026)\n"
+			"    --binary-port port            : also accept binary control protocol clients on this port (default off)\n"
+			"    --nonlinearity file           : load detector nonlinearity correction from file\n"
+			"    --acquisition-mode mode       : triggered (default), pipelined (trigger next exposure during readout)\n"
+			"                                    or continuous (device free-runs bursts of scans into its own memory)\n"
+			"    --burst-frames count          : scans per burst in continuous mode, 1-64 (default 16)\n"
+			"    --frame-rate hz               : trigger at this rate rather than as fast as possible\n"
+			"    --frame-header                : send a header with sequence number and timestamps before each frame\n"
+			"    --reference-clock clock       : also timestamp frames with tai or a PTP clock device (e.g. /dev/ptp0)\n"
+			"    --batch-latency us            : hold frames up to this long to send them together (default 0)\n"
+			"    --batch-frames count          : maximum frames per batch (default 64)\n"
+			"    --sender type                 : socket (default) or uring (asynchronous io_uring sends, if supported)\n"
+			"    --sndbuf bytes                : SO_SNDBUF for the data plane socket\n"
+			"    --notsent-lowat bytes         : TCP_NOTSENT_LOWAT for the data plane socket\n"
+			"    --priority prio               : SO_PRIORITY for the data plane socket\n"
+			"    --dscp codepoint              : DiffServ code point (0-63) for data plane packets\n"
+			"    --busy-poll us                : SO_BUSY_POLL for the data plane socket\n"
+			"    --user-timeout ms             : TCP_USER_TIMEOUT, drop the data client if sent data goes unacked this long\n"
+			"    --keepalive s                 : TCP keepalive idle time on the data plane socket (default 10, 0 = off)\n"
+			"    --send-timeout ms             : disconnect a data client that blocks a send this long (default 5000, 0 = never)\n"
+			"    --ring-depth count            : frames queued for a slow data client before dropping (default 256)\n"
+			"    --worker-threads count        : threads for heavy frame processing (default: one per CPU, 0 = inline)\n"
+			"    --acquisition-cpus list       : CPUs for the acquisition thread, e.g. 2 or 2,3\n"
+			"    --network-cpus list           : CPUs for the data plane sender thread\n"
+			"    --worker-cpus list            : CPUs for processing workers, one worker per CPU round robin, e.g. 4-7\n"
+			"    --acquisition-priority prio   : run the acquisition thread SCHED_FIFO at this priority (1-99)\n"
+			"    --network-priority prio       : run the sender thread SCHED_FIFO at this priority\n"
+			"    --worker-priority prio        : run processing workers SCHED_FIFO at this priority\n"
+			"    --mlockall                    : lock all memory into RAM\n"
+			"    --restart-on-usb-error        : re-open the spectrometer if acquisition fails, instead of stopping\n"
+			"    --hotplug                     : attach and detach the spectrometer as it's plugged in and removed (Linux)\n"
 			"\n"
 			"  [logger options]:\n"
 			"    levels: ERROR, WARNING, NOTICE, VERBOSE, DEBUG\n"
@@ -67,35 +108,17 @@ void help()
 		   );
 }
 
-string g_model;
-string g_serial;
-//string g_fwver;
-
 Socket g_scpiSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
 Socket g_dataSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
-
-#ifdef _WIN32
-BOOL WINAPI OnQuit(DWORD signal);
-#else
-void OnQuit(int signal);
-#endif
+Socket g_binarySocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
 
 uintptr_t g_hDevice = 0;
 
 int g_numPixels = 3653;
 bool g_triggerArmed;
 
-void ReadCalData();
-
-//Wavelengths, in nm, of each spectral bin
-vector<float> g_wavelengths;
-
-//sensor flatness cal
-vector<float> g_sensorResponse;
-
-//abs irradiance cal
-vector<float> g_absResponse;
-float g_absCal = 1;
+//Exposure time, in 10us ticks
+uint32_t g_exposure = 12500;
 
 int main(int argc, char* argv[])
 {
@@ -105,6 +128,11 @@ int main(int argc, char* argv[])
 	//Parse command-line arguments
 	uint16_t scpi_port = 5025;
 	uint16_t waveform_port = 5026;
+	uint16_t binary_port = 0;
+	string nonlinearity_file;
+	size_t worker_threads = thread::hardware_concurrency();
+	bool lock_memory = false;
+	bool hotplug = false;
 	for(int i=1; i<argc; i++)
 	{
 		string s(argv[i]);
@@ -131,6 +159,169 @@ int main(int argc, char* argv[])
 				waveform_port = atoi(argv[++i]);
 		}
 
+		else if(s == "--binary-port")
+		{
+			if(i+1 < argc)
+				binary_port = atoi(argv[++i]);
+		}
+
+		else if(s == "--nonlinearity")
+		{
+			if(i+1 < argc)
+				nonlinearity_file = argv[++i];
+		}
+
+		else if(s == "--acquisition-mode")
+		{
+			AcquisitionMode mode;
+			if( (i+1 < argc) && ParseAcquisitionMode(argv[++i], mode) )
+				g_acquisitionMode = mode;
+			else
+			{
+				fprintf(stderr, "--acquisition-mode requires triggered, pipelined or continuous\n");
+				return 1;
+			}
+		}
+
+		else if(s == "--burst-frames")
+		{
+			char* end = nullptr;
+			unsigned long burst = (i+1 < argc) ? strtoul(argv[++i], &end, 10) : 0;
+			if(!end || (*end != '\0') || (burst < 1) || (burst > MAX_BURST_FRAMES) )
+			{
+				fprintf(stderr, "--burst-frames requires a count from 1 to %d\n", MAX_BURST_FRAMES);
+				return 1;
+			}
+			g_burstFrames = burst;
+		}
+
+		else if(s == "--frame-rate")
+		{
+			char* end = nullptr;
+			double hz = (i+1 < argc) ? strtod(argv[++i], &end) : -1;
+			if(!end || (end == argv[i]) || (*end != '\0') || !SetFrameRate(hz) )
+			{
+				fprintf(stderr, "--frame-rate requires a rate in Hz, 0 or from 1e-6 to 1e6\n");
+				return 1;
+			}
+		}
+
+		else if(s == "--frame-header")
+			g_frameHeaders = true;
+
+		else if(s == "--reference-clock")
+		{
+			if( (i+1 >= argc) || !SetReferenceClock(argv[++i]) )
+			{
+				fprintf(stderr, "--reference-clock requires none, tai or a PTP clock device\n");
+				return 1;
+			}
+		}
+
+		else if(s == "--batch-latency")
+		{
+			if(i+1 < argc)
+				g_batchLatency = atoi(argv[++i]);
+		}
+
+		else if(s == "--batch-frames")
+		{
+			if(i+1 < argc)
+				g_batchMaxFrames = atoi(argv[++i]);
+		}
+
+		else if(s == "--sender")
+		{
+			if( (i+1 >= argc) || !ParseFrameSenderType(argv[++i], g_frameSenderType) )
+			{
+#ifdef HAVE_LIBURING
+				fprintf(stderr, "--sender requires socket or uring\n");
+#else
+				fprintf(stderr, "--sender requires socket (built without io_uring support)\n");
+#endif
+				return 1;
+			}
+		}
+
+		else if( (s == "--sndbuf") || (s == "--notsent-lowat") || (s == "--priority") || (s == "--dscp") ||
+			(s == "--busy-poll") || (s == "--user-timeout") || (s == "--keepalive") )
+		{
+			if(i+1 >= argc)
+			{
+				fprintf(stderr, "%s requires an argument\n", s.c_str());
+				return 1;
+			}
+
+			auto tuning = GetSocketTuning();
+			int value = atoi(argv[++i]);
+			if(s == "--sndbuf")
+				tuning.m_sendBuffer = value;
+			else if(s == "--notsent-lowat")
+				tuning.m_notSentLowWater = value;
+			else if(s == "--priority")
+				tuning.m_priority = value;
+			else if(s == "--dscp")
+				tuning.m_dscp = value;
+			else if(s == "--busy-poll")
+				tuning.m_busyPoll = value;
+			else if(s == "--user-timeout")
+				tuning.m_userTimeout = value;
+			else
+				tuning.m_keepAlive = value;
+			SetSocketTuning(tuning);
+		}
+
+		else if(s == "--send-timeout")
+		{
+			if(i+1 < argc)
+				g_sendTimeout = atoi(argv[++i]);
+		}
+
+		else if(s == "--ring-depth")
+		{
+			if(i+1 < argc)
+				g_ringDepth = max(1, atoi(argv[++i]));
+		}
+
+		else if(s == "--worker-threads")
+		{
+			if(i+1 < argc)
+				worker_threads = atoi(argv[++i]);
+		}
+
+		else if( (s == "--acquisition-cpus") || (s == "--network-cpus") || (s == "--worker-cpus") )
+		{
+			auto role = (s == "--acquisition-cpus") ? THREAD_ACQUISITION :
+				(s == "--network-cpus") ? THREAD_NETWORK : THREAD_PROCESSING;
+			if( (i+1 >= argc) || !ParseCpuList(argv[++i], GetThreadPolicy(role).m_cpus) )
+			{
+				fprintf(stderr, "%s requires a CPU list such as 2 or 4-7 or 1,3\n", s.c_str());
+				return 1;
+			}
+		}
+
+		else if( (s == "--acquisition-priority") || (s == "--network-priority") || (s == "--worker-priority") )
+		{
+			auto role = (s == "--acquisition-priority") ? THREAD_ACQUISITION :
+				(s == "--network-priority") ? THREAD_NETWORK : THREAD_PROCESSING;
+			int prio = (i+1 < argc) ? atoi(argv[++i]) : 0;
+			if( (prio < 1) || (prio > 99) )
+			{
+				fprintf(stderr, "%s requires a priority from 1 to 99\n", s.c_str());
+				return 1;
+			}
+			GetThreadPolicy(role).m_priority = prio;
+		}
+
+		else if(s == "--mlockall")
+			lock_memory = true;
+
+		else if(s == "--restart-on-usb-error")
+			g_restartOnUsbError = true;
+
+		else if(s == "--hotplug")
+			hotplug = true;
+
 		else
 		{
 			fprintf(stderr, "Unrecognized command-line argument \"%s\", use --help\n", s.c_str());
@@ -141,225 +332,97 @@ int main(int argc, char* argv[])
 	//Set up logging
 	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(console_verbosity));
 
-	//Try to find a spectrometer
-	vector<string> serials;
-	auto info = getDevicesInfo();
-	LogDebug("Found %u spectrometer(s)\n", getDevicesCount());
-	for(DeviceInfo_t* p = info; p != nullptr; p = p->next)
-	{
-		LogIndenter li;
-		LogDebug("S/N: %s\n", p->serialNumber);
-		serials.push_back(p->serialNumber);
-	}
-	clearDevicesInfo(info);
-
-	//Connect to the device
-	//connectToDeviceBySerial seems broken! always outputs null...
-	unsigned int ndevice = 0;
-	LogDebug("Connecting to spectrometer with USB interface serial %s...\n", serials[ndevice].c_str());
-	int err;
-	if(0 != (err = connectToDeviceByIndex(ndevice, &g_hDevice) ))
-	{
-		LogError("failed to connect to device code %d\n", err);
-		if(err == CONNECT_ERROR_FAILED)
-			LogNotice("CONNECT_ERROR_FAILED, check permissions on /dev/hidrawX file\n");
-		return 1;
-	}
-	LogNotice("Successfully opened instrument\n");
-
-	ReadCalData();
+	if(lock_memory && LockMemory())
+		LogVerbose("Locked memory\n");
 
-	//Set initial frame format
-	//Frame contains 32 dummy pixels, valid data, 14 dummy pixels
-	uint16_t framesize;
-	if(0 != (err = setFrameFormat(0, g_numPixels-1, 0, &framesize, &g_hDevice)))
+	//Load nonlinearity correction before touching the hardware so a bad file fails fast
+	if(!nonlinearity_file.empty())
 	{
-		LogError("failed to set frame format, code %d\n", err);
-		return 1;
+		auto correction = NonlinearityCorrection::FromFile(nonlinearity_file);
+		if(!correction)
+			return 1;
+		SetNonlinearityCorrection(correction);
+		LogNotice("Loaded nonlinearity correction (%s)\n", correction->GetDescription().c_str());
 	}
-	//LogDebug("framesize = %d\n", framesize);
 
-	//Set exposure, in 10us units
-	//Do 125ms
-	auto exposure = 12500;
-	if(0 != (err = setExposure(exposure, 0, &g_hDevice)))
-	{
-		LogError("failed to set exposure, code %d\n", err);
+	//Connect to the spectrometer. Calibration loads in the background so we can start serving clients right away.
+	//With hotplug enabled it's fine for there to be nothing plugged in yet.
+	if(hotplug && !StartHotplugMonitor())
 		return 1;
-	}
-
-	//Set acquisition parameters to free run capture with no averaging
-	if(0 != (err = setAcquisitionParameters(1, 0, 0, exposure, &g_hDevice)))
+	if(!OpenDevice())
 	{
-		LogError("failed to set acquisition parameters, code %d\n", err);
-		return 1;
+		if(!hotplug)
+			return 1;
+		LogNotice("Waiting for a spectrometer to be plugged in\n");
 	}
 
-	//Do not use external trigger
-	if(0 != (err = setExternalTrigger(0, 0, &g_hDevice)))
+	//Compile the initial processing pipeline. It's recompiled again once calibration is available.
+	RebuildPipeline();
+	if(worker_threads)
 	{
-		LogError("failed to set trigger mode, code %d\n", err);
-		return 1;
+		LogDebug("Starting %zu frame processing threads\n", worker_threads);
+		g_workerPool = new WorkerPool(worker_threads);
 	}
 
 	//Set up signal handlers
-#ifdef _WIN32
-	SetConsoleCtrlHandler(OnQuit, TRUE);
-#else
-	signal(SIGINT, OnQuit);
-	signal(SIGPIPE, SIG_IGN);
-#endif
+	InstallShutdownHandlers();
 
 	//Configure the data plane socket
-	g_dataSocket.Bind(waveform_port);
-	g_dataSocket.Listen();
+	{
+		StartupPhase phase("bind");
+		g_dataSocket.Bind(waveform_port);
+		g_dataSocket.Listen();
 
-	//Launch the control plane socket server
-	g_scpiSocket.Bind(scpi_port);
-	g_scpiSocket.Listen();
+		//Launch the control plane socket server
+		g_scpiSocket.Bind(scpi_port);
+		g_scpiSocket.Listen();
+
+		if(binary_port)
+		{
+			g_binarySocket.Bind(binary_port);
+			g_binarySocket.Listen();
+		}
+	}
 
+	//The binary control plane runs independently of SCPI connections
+	thread binaryThread;
+	if(binary_port)
+		binaryThread = thread(BinaryControlThread);
+
+	RecordStartupMilestone("listening");
 	LogDebug("Ready\n");
 
-	while(true)
+	while(!g_shutdownRequested)
 	{
 		Socket scpiClient = g_scpiSocket.Accept();
 		if(!scpiClient.IsValid())
 			break;
 
 		//Create a server object for this connection
-		AseqSCPIServer server(scpiClient.Detach());
+		ZSOCKET sock = scpiClient.Detach();
+		AseqSCPIServer server(sock);
+		SetControlSocket(sock);
 
 		//Launch the data-plane thread
 		thread dataThread(WaveformServerThread);
 
 		//Process connections on the socket
 		server.MainLoop();
+		ClearControlSocket(sock);
 
 		g_waveformThreadQuit = true;
 		dataThread.join();
-		g_waveformThreadQuit = false;
+		g_waveformThreadQuit = g_shutdownRequested;
 	}
 
-	OnQuit(SIGQUIT);
+	//Data thread has stopped at a frame boundary and flushed its sends, safe to let go of everything
+	if(binaryThread.joinable())
+		binaryThread.join();
+	StopHotplugMonitor();
+	delete g_workerPool;
+	g_workerPool = nullptr;
+	JoinCalibrationLoad();
+	CloseDevice();
+	LogNotice("Shutdown complete\n");
 	return 0;
 }
-
-#ifdef _WIN32
-BOOL WINAPI OnQuit(DWORD signal)
-{
-	(void)signal;
-#else
-void OnQuit(int /*signal*/)
-{
-#endif
-	LogNotice("Shutting down...\n");
-
-	disconnectDeviceContext(&g_hDevice);
-
-	exit(0);
-}
-
-void ReadCalData()
-{
-	//Read calibration data
-	LogDebug("Reading calibration data...\n");
-	LogIndenter li;
-	const int ncal = 97264;	//TODO: is this always the same size?
-	char buf[ncal+1];
-	int err;
-	if(0 != (err = readFlash((uint8_t*)buf, 0, ncal, &g_hDevice)))
-	{
-		LogError("failed to read cal data, code %d\n", err);
-		exit(1);
-	}
-	buf[ncal] = '\0';
-
-	//Parse the text into lines
-	string sbuf(buf);
-	auto lines = explode(sbuf, '\n');
-	LogDebug("Found %zu lines of data\n", lines.size());
-
-	//First line: model c.[Y|N] serial
-	auto firstFields = explode(lines[0], ' ');
-	g_model = Trim(firstFields[0]);
-	g_serial = Trim(firstFields[2]);
-	LogDebug("Spectrometer is model %s, serial %s\n", g_model.c_str(), g_serial.c_str());
-	bool hasAbsCal = (firstFields[1] == "c.Y");
-	if(hasAbsCal)
-		LogDebug("Absolute cal data present\n");
-
-	//Starting at line 13 (one based, per docs) of the file we have 3653 spectral bins worth of wavelength data
-	for(int i=0; i<g_numPixels; i++)
-		g_wavelengths.push_back(atof(lines[i+12].c_str()));
-	LogDebug("First pixel is %.3f nm\n", g_wavelengths[0]);
-	LogDebug("Last pixel is %.3f nm\n", g_wavelengths[g_numPixels-1]);
-
-	//Skip a blank line
-
-	//Read the sensor response normalization data
-	for(int i=0; i<g_numPixels; i++)
-		g_sensorResponse.push_back(atof(lines[i+13+g_numPixels].c_str()));
-	LogDebug("First pixel norm coeff is %.3f\n", g_sensorResponse[0]);
-	LogDebug("Mid pixel norm coeff is %.3f\n", g_sensorResponse[2365]);
-	LogDebug("Last pixel norm coeff is %.3f\n", g_sensorResponse[g_numPixels-1]);
-
-	//Read absolute irradiance data, if present
-	g_absCal = atof(lines[1].c_str());
-	for(int i=0; i<g_numPixels; i++)
-		g_absResponse.push_back(atof(lines[i+13+2*g_numPixels].c_str()));
-}
-
-/**
-	@brief Splits a string up into an array separated by delimiters
- */
-vector<string> explode(const string& str, char separator)
-{
-	vector<string> ret;
-	string tmp;
-	for(auto c : str)
-	{
-		if(c == separator)
-		{
-			if(!tmp.empty())
-				ret.push_back(tmp);
-			tmp = "";
-		}
-		else
-			tmp += c;
-	}
-	if(!tmp.empty())
-		ret.push_back(tmp);
-	return ret;
-}
-
-/**
-	@brief Removes whitespace from the start and end of a string
- */
-string Trim(const string& str)
-{
-	string ret;
-	string tmp;
-
-	//Skip leading spaces
-	size_t i=0;
-	for(; i<str.length() && isspace(str[i]); i++)
-	{}
-
-	//Read non-space stuff
-	for(; i<str.length(); i++)
-	{
-		//Non-space
-		char c = str[i];
-		if(!isspace(c))
-		{
-			ret = ret + tmp + c;
-			tmp = "";
-		}
-
-		//Space. Save it, only append if we have non-space after
-		else
-			tmp += c;
-	}
-
-	return ret;
-}
@@ -38,6 +38,7 @@
 #include <shlwapi.h>
 #endif
 
+#include <atomic>
 #include <thread>
 #include <map>
 #include <mutex>
@@ -46,23 +47,23 @@
 
 extern Socket g_scpiSocket;
 extern Socket g_dataSocket;
+extern Socket g_binarySocket;
 
 void WaveformServerThread();
 
-extern std::string g_model;
-extern std::string g_serial;
-extern std::string g_fwver;
-
 extern std::mutex g_mutex;
 
 extern int g_numPixels;
 
 extern volatile bool g_waveformThreadQuit;
+extern volatile bool g_frameHeaders;
+extern volatile unsigned int g_batchLatency;
+extern volatile unsigned int g_batchMaxFrames;
+extern size_t g_ringDepth;
+extern volatile bool g_dataClientConnected;
+extern std::atomic<uint64_t> g_framesDropped;
 
-extern std::vector<float> g_wavelengths;
-extern std::vector<float> g_sensorResponse;
-extern std::vector<float> g_absResponse;
-extern float g_absCal;
+extern uint32_t g_exposure;
 
 extern bool g_triggerArmed;
 extern bool g_triggerOneShot;
@@ -0,0 +1,185 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for CalibrationParser
+ */
+
+#include "Test.h"
+#include "../specbridge/specbridge.h"
+#include "../specbridge/Calibration.h"
+#include <string.h>
+
+using namespace std;
+
+int g_testFailures = 0;
+
+#define NUM_PIXELS 4
+
+static string MakeCalibration(const char* header, size_t tables);
+static shared_ptr<Calibration> Parse(const string& text, bool& complete);
+static string DropLastLine(const string& text);
+static void TestHeader();
+static void TestComplete();
+static void TestWithoutAbsCal();
+static void TestTruncated();
+
+/**
+	@brief Builds calibration text as found in flash, with CRLF line endings
+
+	@param header	First line
+	@param tables	How many of the per-pixel tables to include (wavelength, response, irradiance)
+ */
+static string MakeCalibration(const char* header, size_t tables)
+{
+	string text = string(header) + "\r\n1.5\r\n";
+
+	//Lines 3 to 12 aren't used
+	for(int i=0; i<10; i++)
+		text += "0\r\n";
+
+	for(size_t t=0; t<tables; t++)
+	{
+		//Blank line between the wavelength and response tables
+		if(t == 1)
+			text += "\r\n";
+		for(size_t i=0; i<NUM_PIXELS; i++)
+			text += to_string(100*(t+1) + i) + "\r\n";
+	}
+	return text;
+}
+
+/**
+	@brief Feeds text to a parser a line at a time, like the loader does, stopping once it's complete or fails
+ */
+static shared_ptr<Calibration> Parse(const string& text, bool& complete)
+{
+	CalibrationParser parser(NUM_PIXELS);
+	size_t start = 0;
+	while( (start < text.size()) && !parser.IsComplete() )
+	{
+		size_t eol = text.find('\n', start);
+		if(eol == string::npos)
+			eol = text.size();
+		if(!parser.OnLine(text.c_str() + start, eol - start))
+			break;
+		start = eol + 1;
+	}
+
+	complete = parser.IsComplete();
+	return parser.Finish();
+}
+
+static string DropLastLine(const string& text)
+{
+	return text.substr(0, text.rfind('\n', text.size() - 2) + 1);
+}
+
+static void TestHeader()
+{
+	string model;
+	string serial;
+	bool hasAbsCal = false;
+	const char* line = "LR1-B c.Y 12345 trailing";
+	TEST_CHECK(Calibration::ParseHeader(line, strlen(line), model, hasAbsCal, serial));
+	TEST_CHECK( (model == "LR1-B") && hasAbsCal && (serial == "12345") );
+
+	line = "LR1-B c.N 12345";
+	TEST_CHECK(Calibration::ParseHeader(line, strlen(line), model, hasAbsCal, serial));
+	TEST_CHECK(!hasAbsCal);
+
+	//Length is honored even if there's more text after it
+	TEST_CHECK(!Calibration::ParseHeader(line, 5, model, hasAbsCal, serial));
+	TEST_CHECK(!Calibration::ParseHeader("", 0, model, hasAbsCal, serial));
+
+	bool complete;
+	TEST_CHECK(Parse("garbage\r\n", complete) == nullptr);
+	TEST_CHECK(!complete);
+}
+
+static void TestComplete()
+{
+	bool complete;
+	auto cal = Parse(MakeCalibration("LR1 c.Y 42", 3) + "trailing junk that is never read\r\n", complete);
+	TEST_CHECK(complete);
+	TEST_CHECK(cal != nullptr);
+	if(!cal)
+		return;
+
+	TEST_CHECK( (cal->m_model == "LR1") && (cal->m_serial == "42") && cal->m_hasAbsCal );
+	TEST_CHECK(cal->m_absCal == 1.5f);
+	TEST_CHECK(cal->m_tables.size() == 3*NUM_PIXELS);
+	TEST_CHECK( (cal->GetWavelengths()[0] == 100) && (cal->GetWavelengths()[NUM_PIXELS-1] == 103) );
+	TEST_CHECK( (cal->GetSensorResponse()[0] == 200) && (cal->GetSensorResponse()[NUM_PIXELS-1] == 203) );
+	TEST_CHECK( (cal->GetAbsResponse() != nullptr) && (cal->GetAbsResponse()[NUM_PIXELS-1] == 303) );
+}
+
+static void TestWithoutAbsCal()
+{
+	bool complete;
+	auto cal = Parse(MakeCalibration("LR1 c.N 42", 2), complete);
+	TEST_CHECK(complete);
+	TEST_CHECK( (cal != nullptr) && (cal->GetAbsResponse() == nullptr) );
+}
+
+static void TestTruncated()
+{
+	bool complete;
+
+	//Header only, or cut off partway through the wavelength or response tables: no calibration
+	TEST_CHECK(Parse("LR1 c.Y 42\r\n", complete) == nullptr);
+	string text = MakeCalibration("LR1 c.Y 42", 1);
+	TEST_CHECK(Parse(DropLastLine(text), complete) == nullptr);
+	TEST_CHECK(!complete);
+	text = MakeCalibration("LR1 c.Y 42", 2);
+	TEST_CHECK(Parse(DropLastLine(text), complete) == nullptr);
+	TEST_CHECK(!complete);
+
+	//Cut off in the irradiance table: the rest is still usable, without absolute irradiance
+	text = MakeCalibration("LR1 c.Y 42", 3);
+	auto cal = Parse(DropLastLine(text), complete);
+	TEST_CHECK(!complete);
+	TEST_CHECK(cal != nullptr);
+	if(cal)
+	{
+		TEST_CHECK(cal->m_tables.size() == 2*NUM_PIXELS);
+		TEST_CHECK(cal->GetAbsResponse() == nullptr);
+	}
+}
+
+int main()
+{
+	TestHeader();
+	TestComplete();
+	TestWithoutAbsCal();
+	TestTruncated();
+	return TEST_RESULT();
+}
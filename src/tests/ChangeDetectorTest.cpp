@@ -0,0 +1,176 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for ChangeDetector
+ */
+
+#include "Test.h"
+#include "../specbridge/specbridge.h"
+#include "../specbridge/ChangeDetector.h"
+
+using namespace std;
+
+int g_testFailures = 0;
+
+#define NUM_BANDS 32
+
+static Frame MakeFrame(int64_t time, float level);
+static void Configure(ChangeMetric metric);
+static void TestDisabled();
+static void TestSuppression();
+static void TestGapAlwaysSent();
+static void TestKeyframeInterval();
+static void TestBandMetric();
+
+static Frame MakeFrame(int64_t time, float level)
+{
+	Frame frame;
+	frame.m_midExposure = time;
+	frame.m_bands.assign(NUM_BANDS, level);
+	return frame;
+}
+
+static void Configure(ChangeMetric metric)
+{
+	g_changeDetection = true;
+	g_changeMetric = metric;
+	g_changeThreshold = 0.01;
+	g_keyframeInterval = 0;
+	g_framesUnchanged = 0;
+}
+
+static void TestDisabled()
+{
+	Configure(CHANGE_NORM);
+	g_changeDetection = false;
+
+	ChangeDetector cd;
+	for(int i=0; i<3; i++)
+	{
+		auto frame = MakeFrame(i, 100);
+		TEST_CHECK(cd.Offer(frame));
+		TEST_CHECK(frame.m_flags == 0);
+	}
+	TEST_CHECK(g_framesUnchanged == 0);
+}
+
+static void TestSuppression()
+{
+	Configure(CHANGE_NORM);
+	ChangeDetector cd;
+
+	//First frame has nothing to compare against, so it's a keyframe
+	auto frame = MakeFrame(0, 100);
+	TEST_CHECK(cd.Offer(frame));
+	TEST_CHECK(frame.m_flags == FRAME_FLAG_KEYFRAME);
+
+	frame = MakeFrame(1, 100.5);
+	TEST_CHECK(!cd.Offer(frame));
+	TEST_CHECK(g_framesUnchanged == 1);
+
+	//Compared to the last frame sent, not the last frame seen, so drift adds up
+	frame = MakeFrame(2, 101.2);
+	TEST_CHECK(cd.Offer(frame));
+	TEST_CHECK(frame.m_flags == 0);
+
+	frame = MakeFrame(3, 101.2);
+	TEST_CHECK(!cd.Offer(frame));
+	TEST_CHECK(g_framesUnchanged == 2);
+}
+
+/**
+	@brief A frame after dropped frames goes out even if it hasn't changed, so the client sees the gap
+ */
+static void TestGapAlwaysSent()
+{
+	Configure(CHANGE_NORM);
+	ChangeDetector cd;
+
+	auto frame = MakeFrame(0, 100);
+	TEST_CHECK(cd.Offer(frame));
+
+	frame = MakeFrame(1, 100);
+	frame.m_flags = FRAME_FLAG_GAP;
+	TEST_CHECK(cd.Offer(frame));
+	TEST_CHECK(frame.m_flags == (FRAME_FLAG_GAP | FRAME_FLAG_KEYFRAME));
+	TEST_CHECK(g_framesUnchanged == 0);
+
+	frame = MakeFrame(2, 100);
+	TEST_CHECK(!cd.Offer(frame));
+}
+
+static void TestKeyframeInterval()
+{
+	Configure(CHANGE_NORM);
+	g_keyframeInterval = 1;
+	ChangeDetector cd;
+
+	auto frame = MakeFrame(0, 100);
+	TEST_CHECK(cd.Offer(frame));
+
+	frame = MakeFrame(999999999, 100);
+	TEST_CHECK(!cd.Offer(frame));
+
+	frame = MakeFrame(1000000000, 100);
+	TEST_CHECK(cd.Offer(frame));
+	TEST_CHECK(frame.m_flags == FRAME_FLAG_KEYFRAME);
+}
+
+/**
+	@brief A narrow feature is averaged away by the norm, but caught by the per-band metric
+ */
+static void TestBandMetric()
+{
+	ChangeMetric metrics[] = {CHANGE_NORM, CHANGE_BAND};
+	for(auto metric : metrics)
+	{
+		Configure(metric);
+		ChangeDetector cd;
+
+		auto frame = MakeFrame(0, 100);
+		TEST_CHECK(cd.Offer(frame));
+
+		frame = MakeFrame(1, 100);
+		frame.m_bands[NUM_BANDS/2] = 105;
+		TEST_CHECK(cd.Offer(frame) == (metric == CHANGE_BAND));
+	}
+}
+
+int main()
+{
+	TestDisabled();
+	TestSuppression();
+	TestGapAlwaysSent();
+	TestKeyframeInterval();
+	TestBandMetric();
+	return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for CommandTable
+ */
+
+#include "Test.h"
+#include "../specbridge/specbridge.h"
+#include "../specbridge/CommandTable.h"
+
+using namespace std;
+
+int g_testFailures = 0;
+
+static void TestArguments();
+static void TestSubjects();
+static void TestHandlerFailure();
+
+/**
+	@brief Handlers only run if the arguments match what the command expects
+ */
+static void TestArguments()
+{
+	CommandTable t;
+	int calls = 0;
+	double number = 0;
+	vector<double> numbers;
+	t.AddCommand("BURST", CMD_ARGS_NUMBER, [&](const CommandArgs& args)
+		{
+			calls ++;
+			number = args.m_number;
+			return true;
+		},
+		1, 10);
+	t.AddCommand("START", CMD_ARGS_NONE, [&](const CommandArgs&)
+		{
+			calls ++;
+			return true;
+		});
+	t.AddCommand("COEFFS", CMD_ARGS_NUMBERS, [&](const CommandArgs& args)
+		{
+			calls ++;
+			numbers = args.m_numbers;
+			return true;
+		});
+
+	TEST_CHECK(t.Command("BURST 5", "", "BURST", {"5"}));
+	TEST_CHECK( (calls == 1) && (number == 5) );
+
+	//Out of range, not a number, trailing junk, wrong count: all handled, none reach the handler
+	TEST_CHECK(t.Command("BURST 11", "", "BURST", {"11"}));
+	TEST_CHECK(t.Command("BURST 0", "", "BURST", {"0"}));
+	TEST_CHECK(t.Command("BURST x", "", "BURST", {"x"}));
+	TEST_CHECK(t.Command("BURST 5x", "", "BURST", {"5x"}));
+	TEST_CHECK(t.Command("BURST", "", "BURST", {}));
+	TEST_CHECK(t.Command("BURST 5 6", "", "BURST", {"5", "6"}));
+	TEST_CHECK(t.Command("START 1", "", "START", {"1"}));
+	TEST_CHECK(t.Command("COEFFS 1 y", "", "COEFFS", {"1", "y"}));
+	TEST_CHECK( (calls == 1) && (number == 5) );
+
+	TEST_CHECK(t.Command("START", "", "START", {}));
+	TEST_CHECK(t.Command("COEFFS 1 -2.5 3e2", "", "COEFFS", {"1", "-2.5", "3e2"}));
+	TEST_CHECK(calls == 3);
+	TEST_CHECK( (numbers.size() == 3) && (numbers[0] == 1) && (numbers[1] == -2.5) && (numbers[2] == 300) );
+
+	//Not ours, so the caller can try elsewhere
+	TEST_CHECK(!t.Command("NOPE", "", "NOPE", {}));
+}
+
+/**
+	@brief An exact subject match wins over an entry that accepts any subject
+ */
+static void TestSubjects()
+{
+	CommandTable t;
+	t.AddQuery("POINTS", []{ return string("any"); });
+	t.AddQuery("PIPE:POINTS", []{ return string("pipe"); });
+	t.AddQuery("PIPE:STAGES", []{ return string("stages"); });
+
+	string reply;
+	TEST_CHECK(t.Query("", "POINTS", reply) && (reply == "any"));
+	TEST_CHECK(t.Query("PIPE", "POINTS", reply) && (reply == "pipe"));
+	TEST_CHECK(t.Query("C1", "POINTS", reply) && (reply == "any"));
+	TEST_CHECK(t.Query("PIPE", "STAGES", reply) && (reply == "stages"));
+
+	//Subject specific entries don't match other subjects, or none
+	TEST_CHECK(!t.Query("", "STAGES", reply));
+	TEST_CHECK(!t.Query("C1", "STAGES", reply));
+	TEST_CHECK(!t.Query("PIPE", "NOPE", reply));
+}
+
+/**
+	@brief A handler that fails still counts as handling the command
+ */
+static void TestHandlerFailure()
+{
+	CommandTable t;
+	int calls = 0;
+	t.AddCommand("EXPOSURE", CMD_ARGS_NUMBER, [&](const CommandArgs&)
+		{
+			calls ++;
+			return false;
+		});
+
+	TEST_CHECK(t.Command("EXPOSURE 1", "", "EXPOSURE", {"1"}));
+	TEST_CHECK(calls == 1);
+}
+
+int main()
+{
+	TestArguments();
+	TestSubjects();
+	TestHandlerFailure();
+	return TEST_RESULT();
+}
@@ -0,0 +1,157 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for EventCapture
+ */
+
+#include "Test.h"
+#include "../specbridge/specbridge.h"
+#include "../specbridge/Acquisition.h"
+#include "../specbridge/EventCapture.h"
+
+using namespace std;
+
+int g_testFailures = 0;
+
+//Stand-ins for the parts of the bridge EventCapture calls, so the test controls the clock and frame rate
+size_t g_ringDepth = 16;
+static int64_t g_now = 0;
+
+int64_t GetMonotonicTime()
+{
+	return g_now;
+}
+
+double GetFrameRate()
+{
+	return 100;
+}
+
+double GetMaxFrameRate()
+{
+	return 1000;
+}
+
+//Frames every 10 ms, each exposing for 1 ms
+#define FRAME_PERIOD_NS	10000000LL
+
+static shared_ptr<Frame> MakeFrame(uint64_t sequence);
+static void TestSettings();
+static void TestPassThrough();
+static void TestEvent();
+
+static shared_ptr<Frame> MakeFrame(uint64_t sequence)
+{
+	auto frame = make_shared<Frame>();
+	frame->m_sequence = sequence;
+	frame->m_exposure = 100;
+	frame->m_midExposure = sequence * FRAME_PERIOD_NS + 500000;
+	return frame;
+}
+
+static void TestSettings()
+{
+	TEST_CHECK(!SetEventFrames(3, 0));
+	TEST_CHECK(!SetEventFrames(10, 7));
+	TEST_CHECK(SetEventFrames(10, 6));
+	TEST_CHECK( (GetEventPreFrames() == 10) && (GetEventPostFrames() == 6) );
+
+	//50 ms at 100 Hz
+	TEST_CHECK(SetEventFrames(0, 2));
+	TEST_CHECK(SetEventDelay(50000000000000ULL));
+	TEST_CHECK(GetEventPreFrames() == 5);
+
+	//Longer than the ring holds: as many as fit
+	TEST_CHECK(SetEventDelay(1000000000000000ULL));
+	TEST_CHECK(GetEventPreFrames() == g_ringDepth - 2);
+}
+
+static void TestPassThrough()
+{
+	g_eventCapture = false;
+	EventCapture ec;
+	vector<shared_ptr<Frame> > ready;
+	for(uint64_t i=0; i<5; i++)
+		ec.Offer(MakeFrame(i), ready);
+	TEST_CHECK(ready.size() == 5);
+	for(auto& f : ready)
+		TEST_CHECK(f->m_flags == 0);
+}
+
+/**
+	@brief Nothing is sent until the event is complete, then the history and post-trigger frames go out together
+ */
+static void TestEvent()
+{
+	g_eventCapture = true;
+	TEST_CHECK(SetEventFrames(3, 2));
+	EventCapture ec;
+	vector<shared_ptr<Frame> > ready;
+
+	for(uint64_t i=0; i<8; i++)
+		ec.Offer(MakeFrame(i), ready);
+	TEST_CHECK(ready.empty());
+
+	//Fired after frame 7 finished exposing: frame 8 is the trigger frame
+	g_now = 7 * FRAME_PERIOD_NS + 5000000;
+	FireEvent();
+	ec.Offer(MakeFrame(8), ready);
+	TEST_CHECK(ready.empty());
+
+	//Another trigger while the event is still being captured is dropped
+	FireEvent();
+	ec.Offer(MakeFrame(9), ready);
+	TEST_CHECK(ready.size() == 5);
+	for(size_t i=0; i<ready.size(); i++)
+	{
+		TEST_CHECK(ready[i]->m_sequence == 5 + i);
+		if(i < 3)
+			TEST_CHECK(ready[i]->m_flags == FRAME_FLAG_PRETRIGGER);
+		else if(i == 3)
+			TEST_CHECK(ready[i]->m_flags == FRAME_FLAG_TRIGGER);
+		else
+			TEST_CHECK(ready[i]->m_flags == 0);
+	}
+
+	ready.clear();
+	for(uint64_t i=10; i<20; i++)
+		ec.Offer(MakeFrame(i), ready);
+	TEST_CHECK(ready.empty());
+}
+
+int main()
+{
+	TestSettings();
+	TestPassThrough();
+	TestEvent();
+	return TEST_RESULT();
+}
@@ -0,0 +1,99 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for FrameReorderBuffer
+ */
+
+#include "Test.h"
+#include "../specbridge/specbridge.h"
+#include "../specbridge/FrameReorderBuffer.h"
+
+using namespace std;
+
+int g_testFailures = 0;
+
+static shared_ptr<Frame> MakeFrame(uint64_t sequence);
+static void TestOutOfOrder();
+static void TestBlocking();
+
+static shared_ptr<Frame> MakeFrame(uint64_t sequence)
+{
+	auto frame = make_shared<Frame>();
+	frame->m_sequence = sequence;
+	return frame;
+}
+
+static void TestOutOfOrder()
+{
+	FrameReorderBuffer buf;
+	TEST_CHECK(buf.PopNext(false) == nullptr);
+
+	buf.Complete(MakeFrame(2));
+	buf.Complete(MakeFrame(1));
+	TEST_CHECK(buf.PopNext(false) == nullptr);
+
+	buf.Complete(MakeFrame(0));
+	for(uint64_t i=0; i<3; i++)
+	{
+		auto frame = buf.PopNext(false);
+		TEST_CHECK( (frame != nullptr) && (frame->m_sequence == i) );
+	}
+	TEST_CHECK(buf.PopNext(false) == nullptr);
+}
+
+/**
+	@brief A blocking pop waits for the next frame, not just any frame, to be completed by another thread
+ */
+static void TestBlocking()
+{
+	FrameReorderBuffer buf;
+	buf.Complete(MakeFrame(1));
+
+	thread worker([&]
+		{
+			this_thread::sleep_for(chrono::milliseconds(50));
+			buf.Complete(MakeFrame(0));
+		});
+
+	auto frame = buf.PopNext(true);
+	TEST_CHECK( (frame != nullptr) && (frame->m_sequence == 0) );
+	frame = buf.PopNext(true);
+	TEST_CHECK( (frame != nullptr) && (frame->m_sequence == 1) );
+	worker.join();
+}
+
+int main()
+{
+	TestOutOfOrder();
+	TestBlocking();
+	return TEST_RESULT();
+}
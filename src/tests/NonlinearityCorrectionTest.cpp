@@ -0,0 +1,118 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for NonlinearityCorrection
+
+	File tests write their input to the working directory, which ctest sets to the build directory.
+ */
+
+#include "Test.h"
+#include "../specbridge/NonlinearityCorrection.h"
+#include <math.h>
+#include <stdio.h>
+
+using namespace std;
+
+int g_testFailures = 0;
+
+static shared_ptr<NonlinearityCorrection> LoadText(const char* text);
+static void TestPolynomial();
+static void TestTable();
+static void TestMalformedFiles();
+
+static shared_ptr<NonlinearityCorrection> LoadText(const char* text)
+{
+	const char* path = "nonlinearity-test.txt";
+	FILE* fp = fopen(path, "w");
+	TEST_CHECK(fp != nullptr);
+	if(!fp)
+		return nullptr;
+	fputs(text, fp);
+	fclose(fp);
+
+	auto ret = NonlinearityCorrection::FromFile(path);
+	remove(path);
+	return ret;
+}
+
+static void TestPolynomial()
+{
+	auto nl = LoadText("poly 10, 2\n");
+	TEST_CHECK(nl != nullptr);
+	if(nl)
+	{
+		TEST_CHECK(nl->GetTable()[0] == 10);
+		TEST_CHECK(nl->GetTable()[1000] == 2010);
+	}
+
+	TEST_CHECK(NonlinearityCorrection::FromPolynomial({}) == nullptr);
+}
+
+static void TestTable()
+{
+	auto nl = LoadText("table\n0,0\n1000,2000\n65535,66535\n");
+	TEST_CHECK(nl != nullptr);
+	if(nl)
+	{
+		TEST_CHECK(nl->GetTable()[500] == 1000);
+		TEST_CHECK(fabsf(nl->GetTable()[2000] - 3000) < 0.01f);
+	}
+
+	TEST_CHECK(NonlinearityCorrection::FromTable({0}, {0}) == nullptr);
+	TEST_CHECK(NonlinearityCorrection::FromTable({0, 0}, {0, 1}) == nullptr);
+	TEST_CHECK(NonlinearityCorrection::FromTable({0, 1}, {0}) == nullptr);
+}
+
+/**
+	@brief Anything short of a complete, valid file loads nothing rather than a partial correction
+ */
+static void TestMalformedFiles()
+{
+	TEST_CHECK(NonlinearityCorrection::FromFile("nonexistent-nonlinearity-file.txt") == nullptr);
+	TEST_CHECK(LoadText("") == nullptr);
+	TEST_CHECK(LoadText("spline 1 2 3\n") == nullptr);
+	TEST_CHECK(LoadText("poly\n") == nullptr);
+	TEST_CHECK(LoadText("poly 1 2 x3\n") == nullptr);
+	TEST_CHECK(LoadText("poly 1 2 3x\n") == nullptr);
+
+	//Truncated mid-pair, or a bad value partway through
+	TEST_CHECK(LoadText("table 0 0 1000 2000 65535") == nullptr);
+	TEST_CHECK(LoadText("table 0 0 1000 oops 65535 65535") == nullptr);
+}
+
+int main()
+{
+	TestPolynomial();
+	TestTable();
+	TestMalformedFiles();
+	return TEST_RESULT();
+}
@@ -0,0 +1,186 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for Quantizer
+
+	Lengths are chosen so samples land in both the vector body and the scalar tail of each conversion loop. This is
+	built with -ffast-math like the bridge, which is what the NaN checks need to survive.
+ */
+
+#include "Test.h"
+#include "../specbridge/Quantizer.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+int g_testFailures = 0;
+
+static float FloatFromBits(uint32_t bits);
+static long GetCode(const vector<uint8_t>& out, SampleFormat format, size_t i);
+static void TestFormatNames();
+static void TestRoundTrip(SampleFormat format);
+static void TestSaturation(SampleFormat format);
+static void TestSpecialValues(SampleFormat format);
+
+//Built from bit patterns, since under -ffast-math the compiler may fold NAN and INFINITY expressions
+static const float g_nan = FloatFromBits(0x7fc00000);
+static const float g_posInf = FloatFromBits(0x7f800000);
+static const float g_negInf = FloatFromBits(0xff800000);
+
+static const size_t g_lengths[] = {1, 7, 8, 9, 15, 16, 17, 31, 33, 100};
+
+static float FloatFromBits(uint32_t bits)
+{
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static long GetCode(const vector<uint8_t>& out, SampleFormat format, size_t i)
+{
+	if(format == SAMPLE_INT16)
+	{
+		int16_t code;
+		memcpy(&code, &out[i*sizeof(code)], sizeof(code));
+		return code;
+	}
+	return static_cast<int8_t>(out[i]);
+}
+
+static void TestFormatNames()
+{
+	SampleFormat formats[] = {SAMPLE_FLOAT32, SAMPLE_INT16, SAMPLE_INT8};
+	for(auto format : formats)
+	{
+		SampleFormat parsed;
+		TEST_CHECK(ParseSampleFormat(GetSampleFormatName(format), parsed));
+		TEST_CHECK(parsed == format);
+	}
+
+	SampleFormat parsed;
+	TEST_CHECK(!ParseSampleFormat("INT32", parsed));
+}
+
+/**
+	@brief Values inside the window decode to within half a code of where they started
+ */
+static void TestRoundTrip(SampleFormat format)
+{
+	Quantizer q(format, 1000, -500);
+	for(auto len : g_lengths)
+	{
+		vector<float> in(len);
+		for(size_t i=0; i<len; i++)
+			in[i] = (i * 997) % 1000 + 0.25f;
+
+		vector<uint8_t> out(len * q.GetSampleSize());
+		q.Quantize(&in[0], len, &out[0]);
+		for(size_t i=0; i<len; i++)
+		{
+			float decoded = GetCode(out, format, i)*q.GetScale() + q.GetOffset();
+			TEST_CHECK(fabsf(decoded - in[i]) <= q.GetScale() * 0.501f);
+		}
+	}
+}
+
+/**
+	@brief Values outside the window clamp to the nearest end of it
+ */
+static void TestSaturation(SampleFormat format)
+{
+	Quantizer q(format, 1000, -500);
+	long minCode = (format == SAMPLE_INT16) ? INT16_MIN : INT8_MIN;
+	long maxCode = (format == SAMPLE_INT16) ? INT16_MAX : INT8_MAX;
+
+	for(auto len : g_lengths)
+	{
+		vector<float> in(len);
+		for(size_t i=0; i<len; i++)
+			in[i] = (i & 1) ? 1e30f : -1e30f;
+
+		vector<uint8_t> out(len * q.GetSampleSize());
+		q.Quantize(&in[0], len, &out[0]);
+		for(size_t i=0; i<len; i++)
+			TEST_CHECK(GetCode(out, format, i) == ((i & 1) ? maxCode : minCode));
+	}
+}
+
+/**
+	@brief NaN goes to the bottom of the window and infinities saturate, wherever they fall in the buffer
+ */
+static void TestSpecialValues(SampleFormat format)
+{
+	Quantizer q(format, 1000, -500);
+	long minCode = (format == SAMPLE_INT16) ? INT16_MIN : INT8_MIN;
+	long maxCode = (format == SAMPLE_INT16) ? INT16_MAX : INT8_MAX;
+
+	float mid = 500;
+	vector<uint8_t> midOut(q.GetSampleSize());
+	q.Quantize(&mid, 1, &midOut[0]);
+	long midCode = GetCode(midOut, format, 0);
+
+	const float specials[] = {g_nan, g_posInf, g_negInf};
+	const long expected[] = {minCode, maxCode, minCode};
+	for(auto len : g_lengths)
+	{
+		for(size_t pos=0; pos<len; pos++)
+		{
+			for(size_t j=0; j<3; j++)
+			{
+				vector<float> in(len, mid);
+				in[pos] = specials[j];
+
+				vector<uint8_t> out(len * q.GetSampleSize());
+				q.Quantize(&in[0], len, &out[0]);
+				for(size_t i=0; i<len; i++)
+					TEST_CHECK(GetCode(out, format, i) == ((i == pos) ? expected[j] : midCode));
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestFormatNames();
+
+	SampleFormat formats[] = {SAMPLE_INT16, SAMPLE_INT8};
+	for(auto format : formats)
+	{
+		TestRoundTrip(format);
+		TestSaturation(format);
+		TestSpecialValues(format);
+	}
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* specbridge                                                                                                           *
+*                                                                                                                      *
+* Copyright (c) 2012-2023 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Unit tests for the CPU list parser in ThreadTuning
+ */
+
+#include "Test.h"
+#include "../specbridge/specbridge.h"
+#include "../specbridge/ThreadTuning.h"
+
+#ifdef __linux__
+#include <sched.h>
+#define CPU_LIMIT CPU_SETSIZE
+#else
+#define CPU_LIMIT 1024
+#endif
+
+using namespace std;
+
+int g_testFailures = 0;
+
+static void TestValidLists();
+static void TestMalformedLists();
+static void TestBounds();
+
+static void TestValidLists()
+{
+	vector<int> cpus;
+	TEST_CHECK(ParseCpuList("3", cpus));
+	TEST_CHECK(cpus == vector<int>({3}));
+
+	TEST_CHECK(ParseCpuList("2,4-7", cpus));
+	TEST_CHECK(cpus == vector<int>({2, 4, 5, 6, 7}));
+
+	TEST_CHECK(ParseCpuList("0-0,1", cpus));
+	TEST_CHECK(cpus == vector<int>({0, 1}));
+}
+
+static void TestMalformedLists()
+{
+	vector<int> cpus;
+	const char* lists[] = {"", ",", "1,", ",1", "1,,2", "-1", "3-1", "1-", "a", "1a", "1;2"};
+	for(auto list : lists)
+		TEST_CHECK(!ParseCpuList(list, cpus));
+}
+
+/**
+	@brief Anything that can't go in a cpu_set_t is rejected, before a huge range is expanded
+ */
+static void TestBounds()
+{
+	vector<int> cpus;
+	string last = to_string(CPU_LIMIT - 1);
+	string past = to_string(CPU_LIMIT);
+
+	TEST_CHECK(ParseCpuList(last, cpus));
+	TEST_CHECK(ParseCpuList("0-" + last, cpus));
+	TEST_CHECK(cpus.size() == CPU_LIMIT);
+
+	TEST_CHECK(!ParseCpuList(past, cpus));
+	TEST_CHECK(!ParseCpuList("0-" + past, cpus));
+	TEST_CHECK(!ParseCpuList("0-100000000", cpus));
+	TEST_CHECK(!ParseCpuList("99999999999999999999", cpus));
+}
+
+int main()
+{
+	TestValidLists();
+	TestMalformedLists();
+	TestBounds();
+	return TEST_RESULT();
+}